@@ -0,0 +1,557 @@
+/**
+ * Microbenchmarks of the low-latency components and the matching engine's order book.
+ *
+ * usage: benchmarks [-o <results.json>] [-s <scale>] [-a <core>] [-b <core>] [name filter]...
+ *   -o  also write the results as JSON, to compare builds.
+ *   -s  multiply every iteration count by scale (default 1).
+ *   -a  core the measuring thread is pinned to, -b core of the peer thread in the LFQueue benchmarks.
+ *   Only benchmarks whose name contains one of the filters are run, all of them if none is given.
+ *
+ * Cycles are TSC ticks. Per operation latencies are measured with a rdtscp pair around every operation,
+ * minus the cost of an empty pair, and reported in nanoseconds.
+ */
+
+#include <atomic>
+#include <random>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include "low-latency-components/mem_pool.h"
+#include "low-latency-components/logging.h"
+#include "low-latency-components/time_utils.h"
+#include "low-latency-components/thread_utils.h"
+#include "low-latency-components/latency_probes.h"
+#include "low-latency-components/lock_free_queue.h"
+#include "exchange/matcher/matching_engine.h"
+
+using namespace Common;
+using namespace Exchange;
+
+namespace
+{
+    struct BenchmarkResult
+    {
+        std::string name_;
+        uint64_t ops_ = 0;
+        double cycles_per_op_ = 0;
+        double nanos_per_op_ = 0;
+        /** Per operation latencies, empty for throughput benchmarks. */
+        std::unique_ptr<HdrHistogram> latencies_;
+    };
+
+    struct BenchmarkConfig
+    {
+        double scale_ = 1.0;
+        int core_ = -1;
+        int peer_core_ = -1;
+        std::vector<std::string> filters_;
+
+        [[nodiscard]]
+        auto iterations(const uint64_t n) const noexcept
+        {
+            return std::max<uint64_t>(1, static_cast<uint64_t>(static_cast<double>(n) * scale_));
+        }
+
+        [[nodiscard]]
+        auto selected(const std::string &name) const noexcept
+        {
+            return filters_.empty() || std::any_of(filters_.begin(), filters_.end(),
+                [&](const auto &filter) { return name.find(filter) != std::string::npos; });
+        }
+    };
+
+    /** Cheapest of many back to back rdtscp pairs, taken off every per operation sample. */
+    auto timerOverhead() noexcept -> uint64_t
+    {
+        uint64_t overhead = UINT64_MAX;
+        for (int i = 0; i < 10000; ++i)
+        {
+            const auto start = TSCClock::ticks();
+            overhead = std::min(overhead, TSCClock::ticks() - start);
+        }
+        return overhead;
+    }
+
+    /** Accumulates per operation samples of one benchmark. */
+    class Samples final
+    {
+    public:
+        Samples(std::string name, const uint64_t timer_overhead) :
+            timer_overhead_(timer_overhead)
+        {
+            result_.name_ = std::move(name);
+            result_.latencies_ = std::make_unique<HdrHistogram>();
+        }
+
+        auto add(const uint64_t start, const uint64_t end) noexcept
+        {
+            const auto ticks = end - start > timer_overhead_ ? end - start - timer_overhead_ : 0;
+            total_ticks_ += ticks;
+            ++result_.ops_;
+            result_.latencies_ -> record(TSCClock::instance().tickDeltaToNanos(ticks));
+        }
+
+        auto finish() noexcept -> BenchmarkResult
+        {
+            result_.cycles_per_op_ = static_cast<double>(total_ticks_) / static_cast<double>(std::max<uint64_t>(result_.ops_, 1));
+            result_.nanos_per_op_ = result_.latencies_ -> mean();
+            return std::move(result_);
+        }
+
+    private:
+        const uint64_t timer_overhead_;
+        uint64_t total_ticks_ = 0;
+        BenchmarkResult result_;
+    };
+
+    auto throughputResult(std::string name, const uint64_t ops, const uint64_t ticks) -> BenchmarkResult
+    {
+        BenchmarkResult result;
+        result.name_ = std::move(name);
+        result.ops_ = ops;
+        result.cycles_per_op_ = static_cast<double>(ticks) / static_cast<double>(ops);
+        result.nanos_per_op_ = static_cast<double>(TSCClock::instance().tickDeltaToNanos(ticks)) / static_cast<double>(ops);
+        return result;
+    }
+
+    template<typename T> auto drain(LFQueue<T> &queue) noexcept
+    {
+        for (auto elems = queue.peek(); !elems.empty(); elems = queue.peek())
+            queue.consume(elems.size());
+    }
+
+    /** LFQueue benchmarks: the peer thread produces (throughput) or echoes (round trip). */
+
+    constexpr size_t LFQUEUE_BATCH = 64;
+
+    auto lfqueueProducer(LFQueue<MEClientRequest> *queue, const uint64_t n, std::atomic<bool> *start) noexcept
+    {
+        while (!start -> load(std::memory_order_acquire));
+
+        MEClientRequest request;
+        for (uint64_t sent = 0; sent < n; )
+        {
+            const auto slots = queue -> reserve(std::min<uint64_t>(LFQUEUE_BATCH, n - sent));
+            for (auto &slot : slots)
+            {
+                request.order_id_ = sent++;
+                slot = request;
+            }
+            queue -> commit(slots.size());
+        }
+    }
+
+    auto lfqueueEcho(LFQueue<MEClientRequest> *ping, LFQueue<MEClientRequest> *pong, const uint64_t n) noexcept
+    {
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            std::span<const MEClientRequest> request;
+            while ((request = ping -> peek(1)).empty());
+            *pong -> getNextToWriteTo() = request.front();
+            pong -> updateWriteIndex();
+            ping -> consume(1);
+        }
+    }
+
+    auto benchLFQueueThroughput(const BenchmarkConfig &config) -> BenchmarkResult
+    {
+        const auto n = config.iterations(20'000'000);
+        LFQueue<MEClientRequest> queue(ME_MAX_CLIENT_UPDATES);
+        std::atomic<bool> start = {false};
+        const auto producer = createAndStartThread(config.peer_core_, "Benchmarks/LFQueueProducer", lfqueueProducer, &queue, n, &start);
+
+        const auto start_ticks = TSCClock::ticks();
+        start.store(true, std::memory_order_release);
+        uint64_t received = 0, checksum = 0;
+        while (received < n)
+        {
+            const auto requests = queue.peek();
+            for (const auto &request : requests)
+                checksum += request.order_id_;
+            received += requests.size();
+            queue.consume(requests.size());
+        }
+        const auto end_ticks = TSCClock::ticks();
+
+        producer -> join();
+        delete producer;
+        ASSERT(checksum == n * (n - 1) / 2, "LFQueue throughput benchmark lost messages.");
+        return throughputResult("lfqueue_throughput", n, end_ticks - start_ticks);
+    }
+
+    auto benchLFQueueRoundTrip(const BenchmarkConfig &config, const uint64_t timer_overhead) -> BenchmarkResult
+    {
+        const auto n = config.iterations(1'000'000);
+        LFQueue<MEClientRequest> ping(1024), pong(1024);
+        const auto echo = createAndStartThread(config.peer_core_, "Benchmarks/LFQueueEcho", lfqueueEcho, &ping, &pong, n);
+
+        Samples samples("lfqueue_round_trip", timer_overhead);
+        MEClientRequest request;
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            request.order_id_ = i;
+            const auto start = TSCClock::ticks();
+            *ping.getNextToWriteTo() = request;
+            ping.updateWriteIndex();
+            std::span<const MEClientRequest> reply;
+            while ((reply = pong.peek(1)).empty());
+            const auto end = TSCClock::ticks();
+            ASSERT(reply.front().order_id_ == i, "LFQueue round trip benchmark got a reply out of order.");
+            pong.consume(1);
+            samples.add(start, end);
+        }
+
+        echo -> join();
+        delete echo;
+        return samples.finish();
+    }
+
+    /**
+     * MemPool: half of a full pool is freed in random order so the free list no longer follows memory order,
+     * then a random mix of allocations and frees of random live elements keeps it scattered.
+     */
+    auto benchMemPoolFragmented(const BenchmarkConfig &config, const uint64_t timer_overhead) -> std::vector<BenchmarkResult>
+    {
+        const auto pool_size = ME_MAX_ORDER_IDS;
+        const auto n = config.iterations(4'000'000);
+        MemPool<MEOrder> pool(pool_size);
+        std::mt19937_64 random(42);
+
+        std::vector<MEOrder *> live;
+        live.reserve(pool_size);
+        for (size_t i = 0; i < pool_size; ++i)
+            live.push_back(pool.allocate());
+        std::shuffle(live.begin(), live.end(), random);
+        for (size_t i = 0; i < pool_size / 2; ++i)
+        {
+            pool.deallocate(live.back());
+            live.pop_back();
+        }
+
+        Samples allocations("mempool_allocate_fragmented", timer_overhead);
+        Samples deallocations("mempool_deallocate_fragmented", timer_overhead);
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            const auto allocate = live.size() < pool_size / 4 ||
+                (live.size() < pool_size && random() % 2);
+            if (allocate)
+            {
+                const auto start = TSCClock::ticks();
+                const auto order = pool.allocate();
+                const auto end = TSCClock::ticks();
+                allocations.add(start, end);
+                live.push_back(order);
+            }
+            else
+            {
+                const auto victim = random() % live.size();
+                const auto order = live[victim];
+                live[victim] = live.back();
+                live.pop_back();
+
+                const auto start = TSCClock::ticks();
+                pool.deallocate(order);
+                const auto end = TSCClock::ticks();
+                deallocations.add(start, end);
+            }
+        }
+
+        std::vector<BenchmarkResult> results;
+        results.push_back(allocations.finish());
+        results.push_back(deallocations.finish());
+        return results;
+    }
+
+    /**
+     * Logger::log with the arguments of the engine's "Sending" lines, in bursts that fit the queue so the
+     * producer side cost is measured rather than the backend's disk throughput.
+     */
+    auto benchLoggerLog(const BenchmarkConfig &config, const uint64_t timer_overhead) -> BenchmarkResult
+    {
+        constexpr uint64_t BURST = 1024;
+        const auto n = config.iterations(200'000);
+        Logger logger("benchmarks_logger.log");
+        std::string time_str;
+        const MEClientResponse client_response{ClientResponseType::ACCEPTED, 1, 2, 3, 4, Side::BUY, 100, 0, 10};
+
+        Samples samples("logger_log", timer_overhead);
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            if (i && i % BURST == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+            const auto start = TSCClock::ticks();
+            logger.log("%:% %() % Sending: %. \n",
+                __FILE__, __LINE__, __func__,
+                getCurrentTimeStr(&time_str),
+                client_response);
+            const auto end = TSCClock::ticks();
+            samples.add(start, end);
+        }
+        return samples.finish();
+    }
+
+    /**
+     * Order book benchmarks go through MatchingEngine::processClientRequest(), so every operation includes
+     * publishing its responses and market updates, which are drained outside the timed region.
+     * Each depth gets its own ticker with depth levels of one resting order on both sides.
+     */
+    class BookBench final
+    {
+    public:
+        static constexpr Price MID_PRICE = 100'000;
+        static constexpr Qty LEVEL_QTY = 100;
+        static constexpr ClientId RESTING_CLIENT = 1;
+        static constexpr ClientId BENCH_CLIENT = 2;
+
+        BookBench() :
+            client_requests_(ME_MAX_CLIENT_UPDATES),
+            client_responses_(ME_MAX_CLIENT_UPDATES),
+            market_updates_(ME_MAX_MARKET_UPDATES),
+            matching_engine_(&client_requests_, &client_responses_, &market_updates_)
+        {}
+
+        auto populate(const TickerId ticker_id, const size_t depth) noexcept
+        {
+            for (size_t level = 1; level <= depth; ++level)
+            {
+                rest(ticker_id, Side::BUY, MID_PRICE - static_cast<Price>(level));
+                rest(ticker_id, Side::SELL, MID_PRICE + static_cast<Price>(level));
+            }
+        }
+
+        auto benchAddCancel(const BenchmarkConfig &config, const uint64_t timer_overhead, const TickerId ticker_id,
+            const size_t depth) -> std::vector<BenchmarkResult>
+        {
+            const auto n = config.iterations(200'000);
+            std::mt19937_64 random(ticker_id);
+            Samples adds("book_add_depth_" + std::to_string(depth), timer_overhead);
+            Samples cancels("book_cancel_depth_" + std::to_string(depth), timer_overhead);
+
+            for (uint64_t i = 0; i < n; ++i)
+            {
+                const auto side = i % 2 ? Side::BUY : Side::SELL;
+                const auto level = static_cast<Price>(1 + random() % depth);
+                const auto order_id = next_order_id_++;
+
+                const auto add = request(ClientRequestType::NEW, BENCH_CLIENT, ticker_id, order_id, side,
+                    side == Side::BUY ? MID_PRICE - level : MID_PRICE + level, LEVEL_QTY);
+                auto start = TSCClock::ticks();
+                matching_engine_.processClientRequest(&add);
+                auto end = TSCClock::ticks();
+                adds.add(start, end);
+                drainOutputs();
+
+                const auto cancel = request(ClientRequestType::CANCEL, BENCH_CLIENT, ticker_id, order_id, side, Price_INVALID, Qty_INVALID);
+                start = TSCClock::ticks();
+                matching_engine_.processClientRequest(&cancel);
+                end = TSCClock::ticks();
+                cancels.add(start, end);
+                drainOutputs();
+            }
+
+            std::vector<BenchmarkResult> results;
+            results.push_back(adds.finish());
+            results.push_back(cancels.finish());
+            return results;
+        }
+
+        /** An aggressive order taking every bid level, which is rebuilt untimed before the next sweep. */
+        auto benchSweep(const BenchmarkConfig &config, const uint64_t timer_overhead, const TickerId ticker_id,
+            const size_t depth) -> BenchmarkResult
+        {
+            const auto n = config.iterations(std::max<uint64_t>(20, 2'000'000 / depth));
+            Samples sweeps("book_sweep_depth_" + std::to_string(depth), timer_overhead);
+
+            for (uint64_t i = 0; i < n; ++i)
+            {
+                const auto sweep = request(ClientRequestType::NEW, BENCH_CLIENT, ticker_id, next_order_id_++, Side::SELL,
+                    MID_PRICE - static_cast<Price>(depth), static_cast<Qty>(depth) * LEVEL_QTY);
+                const auto start = TSCClock::ticks();
+                matching_engine_.processClientRequest(&sweep);
+                const auto end = TSCClock::ticks();
+                sweeps.add(start, end);
+                drainOutputs();
+
+                for (size_t level = 1; level <= depth; ++level)
+                    rest(ticker_id, Side::BUY, MID_PRICE - static_cast<Price>(level));
+            }
+            return sweeps.finish();
+        }
+
+    private:
+        ClientRequestLFQueue client_requests_;
+        MEClientResponseLFQueue client_responses_;
+        MEMarketUpdateLFQueue market_updates_;
+        MatchingEngine matching_engine_;
+        OrderId next_order_id_ = 1;
+
+        static auto request(const ClientRequestType type, const ClientId client_id, const TickerId ticker_id,
+            const OrderId order_id, const Side side, const Price price, const Qty qty) noexcept -> MEClientRequest
+        {
+            MEClientRequest client_request;
+            client_request.type_ = type;
+            client_request.client_id_ = client_id;
+            client_request.ticker_id_ = ticker_id;
+            client_request.order_id_ = order_id;
+            client_request.side_ = side;
+            client_request.price_ = price;
+            client_request.qty_ = qty;
+            return client_request;
+        }
+
+        auto rest(const TickerId ticker_id, const Side side, const Price price) noexcept -> void
+        {
+            const auto add = request(ClientRequestType::NEW, RESTING_CLIENT, ticker_id, next_order_id_++, side, price, LEVEL_QTY);
+            matching_engine_.processClientRequest(&add);
+            drainOutputs();
+        }
+
+        auto drainOutputs() noexcept -> void
+        {
+            drain(client_responses_);
+            drain(market_updates_);
+        }
+    };
+
+    auto printResult(const BenchmarkResult &result)
+    {
+        std::cout << std::left << std::setw(34) << result.name_ << std::right
+            << std::setw(12) << result.ops_
+            << std::setw(14) << std::fixed << std::setprecision(1) << result.cycles_per_op_
+            << std::setw(12) << result.nanos_per_op_;
+        if (const auto &latencies = result.latencies_)
+        {
+            std::cout << std::setw(10) << latencies -> percentile(0.50)
+                << std::setw(10) << latencies -> percentile(0.99)
+                << std::setw(10) << latencies -> percentile(0.999)
+                << std::setw(12) << latencies -> max();
+        }
+        std::cout << std::endl;
+    }
+
+    auto writeJson(const std::string &file_name, const std::vector<BenchmarkResult> &results) -> bool
+    {
+        std::ofstream file(file_name);
+        if (!file)
+            return false;
+
+        file << "{\n  \"compiler\": \"" << __VERSION__ << "\",\n"
+            << "  \"tsc_hz\": " << std::fixed << std::setprecision(0) << TSCClock::instance().ticksPerSecond() << ",\n"
+            << "  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const auto &result = results[i];
+            file << "    {\"name\": \"" << result.name_ << "\", \"ops\": " << result.ops_
+                << std::setprecision(2) << ", \"cycles_per_op\": " << result.cycles_per_op_
+                << ", \"ns_per_op\": " << result.nanos_per_op_;
+            if (const auto &latencies = result.latencies_)
+            {
+                file << ", \"p50_ns\": " << latencies -> percentile(0.50)
+                    << ", \"p99_ns\": " << latencies -> percentile(0.99)
+                    << ", \"p999_ns\": " << latencies -> percentile(0.999)
+                    << ", \"max_ns\": " << latencies -> max();
+            }
+            file << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        file << "  ]\n}\n";
+        return static_cast<bool>(file);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    BenchmarkConfig config;
+    std::string json_file;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg(argv[i]);
+        if ((arg == "-o" || arg == "-s" || arg == "-a" || arg == "-b") && i + 1 < argc)
+        {
+            const std::string value(argv[++i]);
+            if (arg == "-o")
+                json_file = value;
+            else if (arg == "-s")
+                config.scale_ = std::stod(value);
+            else if (arg == "-a")
+                config.core_ = std::stoi(value);
+            else
+                config.peer_core_ = std::stoi(value);
+            continue;
+        }
+        if (arg.starts_with("-"))
+        {
+            std::cerr << "usage: " << argv[0] << " [-o <results.json>] [-s <scale>] [-a <core>] [-b <core>] [name filter]..." << std::endl;
+            return EXIT_FAILURE;
+        }
+        config.filters_.emplace_back(arg);
+    }
+
+    if (config.core_ >= 0 && !setThreadCore(config.core_))
+    {
+        std::cerr << "Failed to pin the benchmark thread to core " << config.core_ << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const auto timer_overhead = timerOverhead();
+    std::cout << "TSC: " << std::fixed << std::setprecision(0) << TSCClock::instance().ticksPerSecond() << " Hz"
+        << (TSCClock::instance().isInvariant() ? "" : " (not invariant)")
+        << ", rdtscp pair: " << timer_overhead << " cycles" << std::endl;
+    std::cout << std::left << std::setw(34) << "benchmark" << std::right << std::setw(12) << "ops"
+        << std::setw(14) << "cycles/op" << std::setw(12) << "ns/op" << std::setw(10) << "p50 ns"
+        << std::setw(10) << "p99 ns" << std::setw(10) << "p99.9 ns" << std::setw(12) << "max ns" << std::endl;
+
+    std::vector<BenchmarkResult> results;
+    auto run = [&](auto &&benchmark)
+    {
+        for (auto &result : benchmark())
+        {
+            printResult(result);
+            results.push_back(std::move(result));
+        }
+    };
+    auto single = [](BenchmarkResult result)
+    {
+        std::vector<BenchmarkResult> results;
+        results.push_back(std::move(result));
+        return results;
+    };
+
+    if (config.selected("lfqueue_throughput"))
+        run([&] { return single(benchLFQueueThroughput(config)); });
+    if (config.selected("lfqueue_round_trip"))
+        run([&] { return single(benchLFQueueRoundTrip(config, timer_overhead)); });
+    if (config.selected("mempool"))
+        run([&] { return benchMemPoolFragmented(config, timer_overhead); });
+    if (config.selected("logger_log"))
+        run([&] { return single(benchLoggerLog(config, timer_overhead)); });
+    std::unique_ptr<BookBench> book_bench;
+    const size_t depths[] = {1, 10, 100, 1000, 10000};
+    for (TickerId ticker_id = 0; ticker_id < std::size(depths); ++ticker_id)
+    {
+        const auto depth = depths[ticker_id];
+        const auto add_cancel = config.selected("book_add_depth_" + std::to_string(depth)) ||
+            config.selected("book_cancel_depth_" + std::to_string(depth));
+        const auto sweep = config.selected("book_sweep_depth_" + std::to_string(depth));
+        if (!add_cancel && !sweep)
+            continue;
+
+        if (!book_bench)
+            book_bench = std::make_unique<BookBench>();
+        book_bench -> populate(ticker_id, depth);
+        if (add_cancel)
+            run([&] { return book_bench -> benchAddCancel(config, timer_overhead, ticker_id, depth); });
+        if (sweep)
+            run([&] { return single(book_bench -> benchSweep(config, timer_overhead, ticker_id, depth)); });
+    }
+
+    if (!json_file.empty() && !writeJson(json_file, results))
+    {
+        std::cerr << "Could not write " << json_file << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
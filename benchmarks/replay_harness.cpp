@@ -0,0 +1,379 @@
+/**
+ * Drives a MatchingEngine with a recorded request stream, without an OrderServer or sockets.
+ *
+ * usage: replay_harness [options] <requests file>
+ *        replay_harness --generate <n> <requests file>
+ *   The requests file is a flat array of MEClientRequest. --generate writes n requests of a synthetic flow
+ *   (passive and aggressive orders around a random walk, cancels and modifies) over every ticker.
+ *
+ *   --engine-core <core>     core of the matching engine thread
+ *   --feeder-core <core>     core of the thread writing the ClientRequestLFQueue (this one)
+ *   --responses-core <core>  core of the thread draining the MEClientResponseLFQueue
+ *   --updates-core <core>    core of the thread draining the MEMarketUpdateLFQueue
+ *   --rate <msgs/s>          pace the feeder instead of pushing as fast as the queue takes requests
+ *
+ * Reports the sustained request rate, the latency from writing a request into the queue to draining the
+ * response acknowledging it (ACCEPTED, CANCELED / CANCEL_REJECTED, MODIFIED / MODIFY_REJECTED), and how
+ * many responses and market updates each request turned into.
+ */
+
+#include <array>
+#include <atomic>
+#include <random>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include "low-latency-components/time_utils.h"
+#include "low-latency-components/thread_utils.h"
+#include "low-latency-components/latency_probes.h"
+#include "low-latency-components/lock_free_queue.h"
+#include "exchange/matcher/matching_engine.h"
+
+using namespace Common;
+using namespace Exchange;
+
+namespace
+{
+    struct HarnessConfig
+    {
+        int engine_core_ = -1;
+        int feeder_core_ = -1;
+        int responses_core_ = -1;
+        int updates_core_ = -1;
+        uint64_t rate_ = 0;
+    };
+
+    /** Shared by the feeder and the drain threads. */
+    struct HarnessState
+    {
+        const std::vector<MEClientRequest> *requests_ = nullptr;
+        /** TSC time each request was written into the queue, indexed like requests_. */
+        std::vector<uint64_t> enqueue_ticks_;
+
+        const ClientRequestLFQueue *client_requests_ = nullptr;
+        std::atomic<bool> feeding_done_ = {false};
+
+        /**
+         * The engine consumes a request only after publishing everything it produced, so once every request is
+         * fed and consumed, an empty output queue stays empty.
+         */
+        [[nodiscard]]
+        auto engineIdle() const noexcept
+        {
+            return feeding_done_.load(std::memory_order_acquire) && client_requests_ -> size() == 0;
+        }
+
+        HdrHistogram ack_latencies_;
+        std::array<uint64_t, 256> response_counts_ = {};
+        std::array<uint64_t, 256> update_counts_ = {};
+        std::atomic<uint64_t> last_response_ticks_ = {0};
+        std::atomic<uint64_t> last_update_ticks_ = {0};
+        std::atomic<uint64_t> num_responses_ = {0};
+        std::atomic<uint64_t> num_updates_ = {0};
+    };
+
+    auto loadRequests(const std::string &file_name) -> std::vector<MEClientRequest>
+    {
+        std::ifstream file(file_name, std::ios::binary | std::ios::ate);
+        ASSERT(static_cast<bool>(file), "Could not open " + file_name);
+        const auto size = static_cast<size_t>(file.tellg());
+        ASSERT(size % sizeof(MEClientRequest) == 0, file_name + " is not a whole number of MEClientRequests.");
+
+        std::vector<MEClientRequest> requests(size / sizeof(MEClientRequest));
+        file.seekg(0);
+        file.read(reinterpret_cast<char *>(requests.data()), static_cast<std::streamsize>(size));
+        ASSERT(static_cast<bool>(file), "Could not read " + file_name);
+        return requests;
+    }
+
+    /** Synthetic flow: 60% NEW (a fifth of them aggressive), 30% CANCEL, 10% MODIFY of earlier orders. */
+    auto generateRequests(const uint64_t n, const std::string &file_name) -> void
+    {
+        constexpr ClientId NUM_CLIENTS = 16;
+        constexpr Price START_PRICE = 100'000;
+        std::mt19937_64 random(7);
+        std::array<Price, ME_MAX_TICKERS> mid_prices;
+        mid_prices.fill(START_PRICE);
+        std::array<std::vector<MEClientRequest>, ME_MAX_TICKERS> sent_orders;
+        std::vector<MEClientRequest> requests;
+        requests.reserve(n);
+        OrderId next_order_id = 1;
+
+        while (requests.size() < n)
+        {
+            const auto ticker_id = static_cast<TickerId>(random() % ME_MAX_TICKERS);
+            auto &mid_price = mid_prices[ticker_id];
+            auto &orders = sent_orders[ticker_id];
+            mid_price += static_cast<Price>(random() % 3) - 1;
+
+            MEClientRequest request;
+            request.ticker_id_ = ticker_id;
+            const auto action = random() % 10;
+            if (action < 6 || orders.empty())
+            {
+                request.type_ = ClientRequestType::NEW;
+                request.client_id_ = static_cast<ClientId>(random() % NUM_CLIENTS);
+                request.order_id_ = next_order_id++;
+                request.side_ = random() % 2 ? Side::BUY : Side::SELL;
+                const auto offset = static_cast<Price>(1 + random() % 20);
+                const auto aggressive = random() % 5 == 0;
+                request.price_ = (request.side_ == Side::BUY) == aggressive ? mid_price + offset : mid_price - offset;
+                request.qty_ = static_cast<Qty>(1 + random() % 100);
+                orders.push_back(request);
+            }
+            else
+            {
+                const auto index = random() % orders.size();
+                request = orders[index];
+                if (action < 9)
+                {
+                    request.type_ = ClientRequestType::CANCEL;
+                    orders[index] = orders.back();
+                    orders.pop_back();
+                }
+                else
+                {
+                    request.type_ = ClientRequestType::MODIFY;
+                    request.qty_ = static_cast<Qty>(1 + random() % 100);
+                }
+            }
+            requests.push_back(request);
+        }
+
+        std::ofstream file(file_name, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(requests.data()), static_cast<std::streamsize>(requests.size() * sizeof(MEClientRequest)));
+        ASSERT(static_cast<bool>(file), "Could not write " + file_name);
+    }
+
+    [[nodiscard]]
+    auto acknowledges(const MEClientResponse &response, const MEClientRequest &request) noexcept
+    {
+        if (response.client_id_ != request.client_id_ || response.client_order_id_ != request.order_id_)
+            return false;
+        switch (request.type_)
+        {
+        case ClientRequestType::NEW:
+            return response.type_ == ClientResponseType::ACCEPTED;
+        case ClientRequestType::CANCEL:
+            return response.type_ == ClientResponseType::CANCELED || response.type_ == ClientResponseType::CANCEL_REJECTED;
+        case ClientRequestType::MODIFY:
+            return response.type_ == ClientResponseType::MODIFIED || response.type_ == ClientResponseType::MODIFY_REJECTED;
+        default:
+            return false;
+        }
+    }
+
+    /** Index of the next request that gets an acknowledgement, MASS_CANCELs only produce per order CANCELs. */
+    auto nextAcknowledged(const std::vector<MEClientRequest> &requests, size_t index) noexcept
+    {
+        while (index < requests.size() && requests[index].type_ == ClientRequestType::MASS_CANCEL)
+            ++index;
+        return index;
+    }
+
+    /** Matches acknowledgements to requests in order, the engine handles them strictly in sequence. */
+    auto drainResponses(MEClientResponseLFQueue *responses, HarnessState *state) noexcept
+    {
+        const auto &requests = *state -> requests_;
+        auto next_ack = nextAcknowledged(requests, 0);
+        auto &clock = TSCClock::instance();
+
+        while (true)
+        {
+            const auto idle = state -> engineIdle();
+            const auto client_responses = responses -> peek();
+            if (client_responses.empty())
+            {
+                if (idle)
+                    break;
+                continue;
+            }
+
+            const auto now = TSCClock::ticks();
+            for (const auto &response : client_responses)
+            {
+                ++state -> response_counts_[static_cast<uint8_t>(response.type_)];
+                if (next_ack < requests.size() && acknowledges(response, requests[next_ack]))
+                {
+                    state -> ack_latencies_.record(clock.tickDeltaToNanos(now - state -> enqueue_ticks_[next_ack]));
+                    next_ack = nextAcknowledged(requests, next_ack + 1);
+                }
+            }
+            state -> num_responses_.fetch_add(client_responses.size(), std::memory_order_relaxed);
+            state -> last_response_ticks_.store(now, std::memory_order_relaxed);
+            responses -> consume(client_responses.size());
+        }
+    }
+
+    auto drainUpdates(MEMarketUpdateLFQueue *updates, HarnessState *state) noexcept
+    {
+        while (true)
+        {
+            const auto idle = state -> engineIdle();
+            const auto market_updates = updates -> peek();
+            if (market_updates.empty())
+            {
+                if (idle)
+                    break;
+                continue;
+            }
+
+            for (const auto &update : market_updates)
+                ++state -> update_counts_[static_cast<uint8_t>(update.type_)];
+            state -> num_updates_.fetch_add(market_updates.size(), std::memory_order_relaxed);
+            state -> last_update_ticks_.store(TSCClock::ticks(), std::memory_order_relaxed);
+            updates -> consume(market_updates.size());
+        }
+    }
+
+    auto feed(ClientRequestLFQueue *client_requests, HarnessState *state, const uint64_t rate) noexcept
+    {
+        constexpr size_t BATCH = 64;
+        const auto &requests = *state -> requests_;
+        const auto ticks_per_request = rate ? TSCClock::instance().ticksPerSecond() / static_cast<double>(rate) : 0.0;
+        const auto start = TSCClock::ticks();
+
+        for (size_t sent = 0; sent < requests.size(); )
+        {
+            auto batch = std::min(BATCH, requests.size() - sent);
+            if (rate)
+            {
+                /** Release whatever is due by now, but at least one request once its time has come. */
+                const auto due = static_cast<size_t>(static_cast<double>(TSCClock::ticks() - start) / ticks_per_request) + 1;
+                if (due <= sent)
+                    continue;
+                batch = std::min(batch, due - sent);
+            }
+
+            const auto slots = client_requests -> reserve(batch);
+            const auto now = TSCClock::ticks();
+            for (size_t i = 0; i < slots.size(); ++i)
+            {
+                slots[i] = requests[sent + i];
+                state -> enqueue_ticks_[sent + i] = now;
+            }
+            client_requests -> commit(slots.size());
+            sent += slots.size();
+        }
+        state -> feeding_done_.store(true, std::memory_order_release);
+    }
+
+    auto usage(const char *program) -> int
+    {
+        std::cerr << "usage: " << program << " [--engine-core <core>] [--feeder-core <core>] [--responses-core <core>]"
+            " [--updates-core <core>] [--rate <msgs/s>] <requests file>\n"
+            "       " << program << " --generate <n> <requests file>" << std::endl;
+        return EXIT_FAILURE;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    HarnessConfig config;
+    std::string file_name;
+    uint64_t generate = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg(argv[i]);
+        if (!arg.starts_with("--"))
+        {
+            file_name = arg;
+            continue;
+        }
+        if (i + 1 == argc)
+            return usage(argv[0]);
+
+        const auto value = argv[++i];
+        if (arg == "--engine-core")
+            config.engine_core_ = std::stoi(value);
+        else if (arg == "--feeder-core")
+            config.feeder_core_ = std::stoi(value);
+        else if (arg == "--responses-core")
+            config.responses_core_ = std::stoi(value);
+        else if (arg == "--updates-core")
+            config.updates_core_ = std::stoi(value);
+        else if (arg == "--rate")
+            config.rate_ = std::stoull(value);
+        else if (arg == "--generate")
+            generate = std::stoull(value);
+        else
+            return usage(argv[0]);
+    }
+
+    if (file_name.empty())
+        return usage(argv[0]);
+    if (generate)
+    {
+        generateRequests(generate, file_name);
+        std::cout << "Wrote " << generate << " requests to " << file_name << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    const auto requests = loadRequests(file_name);
+    ASSERT(!requests.empty(), file_name + " holds no requests.");
+    for (const auto &request : requests)
+        ASSERT(request.client_id_ < ME_MAX_NUM_CLIENTS && request.ticker_id_ < ME_MAX_TICKERS,
+            "Request for an invalid client or ticker: " + request.toString());
+
+    if (config.feeder_core_ >= 0 && !setThreadCore(config.feeder_core_))
+    {
+        std::cerr << "Failed to pin the feeder to core " << config.feeder_core_ << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto state = std::make_unique<HarnessState>();
+    state -> requests_ = &requests;
+    state -> enqueue_ticks_.resize(requests.size());
+
+    ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+    MEClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
+    MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+    state -> client_requests_ = &client_requests;
+    auto matching_engine = std::make_unique<MatchingEngine>(&client_requests, &client_responses, &market_updates,
+        0, 1, config.engine_core_);
+
+    const auto responses_thread = createAndStartThread(config.responses_core_, "Harness/Responses", drainResponses, &client_responses, state.get());
+    const auto updates_thread = createAndStartThread(config.updates_core_, "Harness/Updates", drainUpdates, &market_updates, state.get());
+    matching_engine -> start();
+
+    std::cout << "Replaying " << requests.size() << " requests from " << file_name << " ..." << std::endl;
+    const auto start_ticks = TSCClock::ticks();
+    feed(&client_requests, state.get(), config.rate_);
+    responses_thread -> join();
+    updates_thread -> join();
+    delete responses_thread;
+    delete updates_thread;
+    matching_engine -> stop();
+
+    const auto end_ticks = std::max(state -> last_response_ticks_.load(), state -> last_update_ticks_.load());
+    const auto seconds = static_cast<double>(TSCClock::instance().tickDeltaToNanos(end_ticks - start_ticks)) / NANOS_TO_SECS;
+    const auto num_requests = static_cast<double>(requests.size());
+    const auto &latencies = state -> ack_latencies_;
+
+    std::cout << std::fixed << std::setprecision(0)
+        << "requests: " << requests.size() << " in " << std::setprecision(3) << seconds << " s, "
+        << std::setprecision(0) << num_requests / seconds << " msgs/s" << std::endl
+        << "ack latency ns (n=" << latencies.count() << "): mean " << latencies.mean()
+        << " p50 " << latencies.percentile(0.50) << " p90 " << latencies.percentile(0.90)
+        << " p99 " << latencies.percentile(0.99) << " p99.9 " << latencies.percentile(0.999)
+        << " max " << latencies.max() << std::endl
+        << std::setprecision(3)
+        << "amplification: " << static_cast<double>(state -> num_responses_) / num_requests << " responses / request, "
+        << static_cast<double>(state -> num_updates_) / num_requests << " market updates / request" << std::endl;
+
+    for (size_t type = 0; type < state -> response_counts_.size(); ++type)
+    {
+        if (state -> response_counts_[type])
+            std::cout << "  " << std::left << std::setw(16) << clientResponseTypeToString(static_cast<ClientResponseType>(type))
+                << std::right << std::setw(12) << state -> response_counts_[type] << std::endl;
+    }
+    for (size_t type = 0; type < state -> update_counts_.size(); ++type)
+    {
+        if (state -> update_counts_[type])
+            std::cout << "  " << std::left << std::setw(16) << marketUpdateTypeToString(static_cast<MEMarketUpdateType>(type))
+                << std::right << std::setw(12) << state -> update_counts_[type] << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,181 @@
+#include "request_journal.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "low-latency-components/thread_utils.h"
+
+namespace Exchange {
+    namespace {
+        /** Read-only mapping of an existing segment, nullptr if there is no such file. */
+        auto mapSegmentForReading(const std::string &name, size_t *size) -> const std::byte* {
+            const auto fd = open(name.c_str(), O_RDONLY);
+            if (fd < 0)
+                return nullptr;
+
+            struct stat file_stat{};
+            ASSERT(fstat(fd, &file_stat) == 0, "fstat() failed on " + name + ". errno:" + std::string(std::strerror(errno)));
+            *size = file_stat.st_size;
+            const auto data = *size ? mmap(nullptr, *size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0) : MAP_FAILED;
+            close(fd);
+            ASSERT(data != MAP_FAILED, "Could not map journal segment " + name + ". errno:" + std::string(std::strerror(errno)));
+            return static_cast<const std::byte *>(data);
+        }
+
+        auto checkHeader(const std::string &name, const std::byte *data, const size_t size) -> const JournalSegmentHeader* {
+            const auto header = reinterpret_cast<const JournalSegmentHeader *>(data);
+            ASSERT(size >= sizeof(JournalSegmentHeader) &&
+                !memcmp(header -> magic_, JOURNAL_SEGMENT_MAGIC, sizeof(JOURNAL_SEGMENT_MAGIC)),
+                name + " is not a journal segment.");
+            ASSERT(header -> record_size_ == sizeof(JournalRecord),
+                name + " holds records of " + std::to_string(header -> record_size_) + " bytes, expected " +
+                std::to_string(sizeof(JournalRecord)) + ".");
+            return header;
+        }
+    }
+
+    RequestJournal::RequestJournal(const std::string &prefix, const int core_id, const size_t segment_size) :
+        prefix_(prefix),
+        core_id_(core_id),
+        segment_size_(segment_size),
+        records_(ME_MAX_JOURNAL_RECORDS),
+        logger_("exchange_request_journal.log")
+    {
+        ASSERT(segment_size_ >= sizeof(JournalSegmentHeader) + sizeof(JournalRecord),
+            "Journal segments must hold at least one record.");
+
+        while (access(segmentName(prefix_, segment_index_ + 1).c_str(), F_OK) == 0)
+            ++segment_index_;
+        openSegment(1);
+
+        /** Continue after the last record of the newest segment. */
+        const auto header = reinterpret_cast<const JournalSegmentHeader *>(segment_);
+        last_seq_num_ = header -> first_seq_num_ - 1;
+        for (write_offset_ = sizeof(JournalSegmentHeader); write_offset_ + sizeof(JournalRecord) <= mapped_size_;
+             write_offset_ += sizeof(JournalRecord)) {
+            const auto record = reinterpret_cast<const JournalRecord *>(segment_ + write_offset_);
+            if (record -> seq_num_ != last_seq_num_ + 1)
+                break;
+            last_seq_num_ = record -> seq_num_;
+        }
+    }
+
+    RequestJournal::~RequestJournal() {
+        stop();
+
+        using namespace std::literals::chrono_literals;
+        std::this_thread::sleep_for(1s);
+
+        closeSegment();
+    }
+
+    auto RequestJournal::start() -> void {
+        run_ = true;
+        ASSERT(createAndStartThread(core_id_, "Exchange/RequestJournal", [this] { run(); }) != nullptr,
+            "Failed to start RequestJournal thread.");
+    }
+
+    auto RequestJournal::stop() -> void {
+        run_ = false;
+    }
+
+    auto RequestJournal::segmentName(const std::string &prefix, const size_t segment_index) -> std::string {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), ".%06zu", segment_index);
+        return prefix + suffix;
+    }
+
+    auto RequestJournal::replay(const std::string &prefix, const std::function<void(const JournalRecord &)> &on_record) -> uint64_t {
+        uint64_t num_records = 0;
+        uint64_t last_seq_num = 0;
+
+        for (size_t segment_index = 0; ; ++segment_index) {
+            const auto name = segmentName(prefix, segment_index);
+            size_t size = 0;
+            const auto data = mapSegmentForReading(name, &size);
+            if (!data)
+                break;
+
+            const auto header = checkHeader(name, data, size);
+            if (num_records && header -> first_seq_num_ != last_seq_num + 1) {
+                munmap(const_cast<std::byte *>(data), size);
+                break;
+            }
+            last_seq_num = header -> first_seq_num_ - 1;
+
+            auto offset = sizeof(JournalSegmentHeader);
+            for ( ; offset + sizeof(JournalRecord) <= size; offset += sizeof(JournalRecord)) {
+                const auto record = reinterpret_cast<const JournalRecord *>(data + offset);
+                if (record -> seq_num_ != last_seq_num + 1)
+                    break;
+                on_record(*record);
+                last_seq_num = record -> seq_num_;
+                ++num_records;
+            }
+            munmap(const_cast<std::byte *>(data), size);
+
+            /** A segment that stopped short of its end is the tail of the journal. */
+            if (offset + sizeof(JournalRecord) <= size)
+                break;
+        }
+        return num_records;
+    }
+
+    auto RequestJournal::openSegment(const uint64_t first_seq_num) -> void {
+        const auto name = segmentName(prefix_, segment_index_);
+        segment_fd_ = open(name.c_str(), O_RDWR | O_CREAT, 0644);
+        ASSERT(segment_fd_ >= 0, "Could not open journal segment " + name + ". errno:" + std::string(std::strerror(errno)));
+
+        struct stat file_stat{};
+        ASSERT(fstat(segment_fd_, &file_stat) == 0, "fstat() failed on " + name + ". errno:" + std::string(std::strerror(errno)));
+        const auto is_new = file_stat.st_size == 0;
+        if (is_new) {
+            const auto error = posix_fallocate(segment_fd_, 0, static_cast<off_t>(segment_size_));
+            ASSERT(error == 0, "Could not pre-allocate journal segment " + name + ". error:" + std::string(std::strerror(error)));
+        }
+        mapped_size_ = is_new ? segment_size_ : static_cast<size_t>(file_stat.st_size);
+
+        const auto data = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, segment_fd_, 0);
+        ASSERT(data != MAP_FAILED, "Could not map journal segment " + name + ". errno:" + std::string(std::strerror(errno)));
+        segment_ = static_cast<std::byte *>(data);
+        write_offset_ = sizeof(JournalSegmentHeader);
+
+        if (is_new) {
+            JournalSegmentHeader header;
+            memcpy(header.magic_, JOURNAL_SEGMENT_MAGIC, sizeof(JOURNAL_SEGMENT_MAGIC));
+            header.record_size_ = sizeof(JournalRecord);
+            header.first_seq_num_ = first_seq_num;
+            memcpy(segment_, &header, sizeof(header));
+        }
+        checkHeader(name, segment_, mapped_size_);
+    }
+
+    auto RequestJournal::closeSegment() noexcept -> void {
+        if (!segment_)
+            return;
+        msync(segment_, mapped_size_, MS_SYNC);
+        munmap(segment_, mapped_size_);
+        close(segment_fd_);
+        segment_ = nullptr;
+        segment_fd_ = -1;
+    }
+
+    auto RequestJournal::rollSegment() noexcept -> void {
+        msync(segment_, mapped_size_, MS_ASYNC);
+        munmap(segment_, mapped_size_);
+        close(segment_fd_);
+
+        ++segment_index_;
+        openSegment(last_seq_num_ + 1);
+
+        logger_.log("%:% %() % Rolled over to % at seq: %. \n",
+            __FILE__, __LINE__, __func__,
+            getCurrentTimeStr(&time_str_),
+            segmentName(prefix_, segment_index_),
+            last_seq_num_ + 1);
+    }
+}
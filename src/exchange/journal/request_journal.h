@@ -0,0 +1,136 @@
+#pragma once
+
+#ifndef TRADINGECOSYSTEM_REQUEST_JOURNAL_H
+#define TRADINGECOSYSTEM_REQUEST_JOURNAL_H
+
+#include <atomic>
+#include <string>
+#include <functional>
+#include "low-latency-components/macros.h"
+#include "low-latency-components/logging.h"
+#include "low-latency-components/time_utils.h"
+#include "low-latency-components/lock_free_queue.h"
+#include "exchange/order_server/client_request.h"
+
+namespace Exchange {
+    constexpr size_t JOURNAL_SEGMENT_SIZE = 256 * 1024 * 1024;
+    constexpr size_t ME_MAX_JOURNAL_RECORDS = 256 * 1024;
+    constexpr char JOURNAL_SEGMENT_MAGIC[8] = {'T', 'E', 'J', 'O', 'U', 'R', 'N', 'L'};
+
+    /**
+     * One request as the FIFOSequencer handed it to the matching engine(s), numbered by a sequence that is
+     * global across shards. A zero seq_num_ marks the not yet written tail of a segment.
+     */
+    struct alignas(CACHE_LINE_SIZE) JournalRecord {
+        uint64_t seq_num_ = 0;
+        Nanos rx_time_ = 0;
+        MEClientRequest request_;
+    };
+
+    /** First cache line of every segment file, the records follow it back to back. */
+    struct alignas(CACHE_LINE_SIZE) JournalSegmentHeader {
+        char magic_[sizeof(JOURNAL_SEGMENT_MAGIC)] = {};
+        uint32_t record_size_ = 0;
+        uint64_t first_seq_num_ = 0;
+    };
+
+    typedef LFQueue<JournalRecord> JournalRecordLFQueue;
+
+    /**
+     * Write-ahead journal of the sequenced requests in pre-allocated segment files <prefix>.NNNNNN, written
+     * through MAP_SHARED mappings by a thread of its own so the sequencer only pays for an LFQueue write.
+     * A record is copied into its slot before its seq_num_ is stored, so a process dying mid-copy leaves the
+     * slot looking unwritten. The page cache keeps what was written across a process crash; segments are
+     * msync()ed when they are rolled and when the journal is closed.
+     */
+    class RequestJournal final {
+    public:
+        /** Opens the existing segments of prefix and continues after their last record. */
+        explicit RequestJournal(const std::string &prefix, int core_id = -1, size_t segment_size = JOURNAL_SEGMENT_SIZE);
+        ~RequestJournal();
+
+        auto start() -> void;
+        auto stop()  -> void;
+
+        [[nodiscard]]
+        auto records() noexcept { return &records_; }
+
+        /** Sequence number of the last record journaled before this instance was opened, 0 if none. */
+        [[nodiscard]]
+        auto lastSeqNum() const noexcept { return last_seq_num_; }
+
+        /**
+         * Calls on_record for every record in the segments of prefix, in sequence order, stopping at the first
+         * unwritten slot or gap in the sequence. Returns the number of records replayed.
+         */
+        static auto replay(const std::string &prefix, const std::function<void(const JournalRecord &)> &on_record) -> uint64_t;
+
+        static auto segmentName(const std::string &prefix, size_t segment_index) -> std::string;
+
+        auto run() noexcept {
+            logger_.log("%:% %() % Journaling into % from seq: %. \n",
+                __FILE__, __LINE__, __func__,
+                getCurrentTimeStr(&time_str_),
+                segmentName(prefix_, segment_index_),
+                last_seq_num_ + 1);
+
+            while (run_)
+                drain();
+            drain();
+        }
+
+        RequestJournal() = delete;
+        RequestJournal(const RequestJournal & ) = delete;
+        RequestJournal(const RequestJournal &&) = delete;
+        RequestJournal &operator = (const RequestJournal & ) = delete;
+        RequestJournal &operator = (const RequestJournal &&) = delete;
+
+    private:
+        const std::string prefix_;
+        const int core_id_ = -1;
+        const size_t segment_size_ = JOURNAL_SEGMENT_SIZE;
+        JournalRecordLFQueue records_;
+
+        size_t segment_index_ = 0;
+        int segment_fd_ = -1;
+        std::byte *segment_ = nullptr;
+        size_t mapped_size_ = 0;
+        size_t write_offset_ = 0;
+        uint64_t last_seq_num_ = 0;
+
+        volatile bool run_ = false;
+        std::string time_str_;
+        Logger logger_;
+
+        auto drain() noexcept -> void {
+            const auto records = records_.peek();
+            for (const auto &record : records)
+                append(record);
+            records_.consume(records.size());
+        }
+
+        auto append(const JournalRecord &record) noexcept -> void {
+            if (UNLIKELY(record.seq_num_ != last_seq_num_ + 1)) {
+                FATAL("RequestJournal received seq: " + std::to_string(record.seq_num_) +
+                    " after: " + std::to_string(last_seq_num_));
+            }
+            if (UNLIKELY(write_offset_ + sizeof(JournalRecord) > mapped_size_))
+                rollSegment();
+
+            const auto slot = reinterpret_cast<JournalRecord *>(segment_ + write_offset_);
+            slot -> rx_time_ = record.rx_time_;
+            slot -> request_ = record.request_;
+            std::atomic_ref<uint64_t>(slot -> seq_num_).store(record.seq_num_, std::memory_order_release);
+
+            write_offset_ += sizeof(JournalRecord);
+            last_seq_num_ = record.seq_num_;
+        }
+
+        /** Maps segment segment_index_, creating and pre-allocating it if it does not exist yet. */
+        auto openSegment(uint64_t first_seq_num) -> void;
+        auto closeSegment() noexcept -> void;
+        auto rollSegment() noexcept -> void;
+    };
+}
+
+#endif //TRADINGECOSYSTEM_REQUEST_JOURNAL_H
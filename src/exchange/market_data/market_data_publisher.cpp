@@ -1 +1,67 @@
-#include "market_data_publisher.h"
\ No newline at end of file
+#include "market_data_publisher.h"
+
+namespace Exchange {
+    MarketDataPublisher::MarketDataPublisher(
+        MEMarketUpdateLFQueue *market_updates,
+        const std::string &iface,
+        const std::string &incremental_ip,
+        const int incremental_port,
+        const std::string &snapshot_ip,
+        const int snapshot_port,
+        const size_t max_datagram_size,
+        const Nanos batch_budget) :
+        MarketDataPublisher(std::vector<MEMarketUpdateLFQueue *>{market_updates}, iface,
+            incremental_ip, incremental_port, snapshot_ip, snapshot_port, max_datagram_size, batch_budget)
+        {}
+
+    MarketDataPublisher::MarketDataPublisher(
+        const std::vector<MEMarketUpdateLFQueue *> &market_updates,
+        const std::string &iface,
+        const std::string &incremental_ip,
+        const int incremental_port,
+        const std::string &snapshot_ip,
+        const int snapshot_port,
+        const size_t max_datagram_size,
+        const Nanos batch_budget) :
+        outgoing_md_updates_(market_updates),
+        snapshot_md_updates_(ME_MAX_MARKET_UPDATES),
+        max_datagram_size_(max_datagram_size),
+        batch_budget_ticks_(static_cast<uint64_t>(static_cast<double>(batch_budget) *
+            TSCClock::instance().ticksPerSecond() / NANOS_TO_SECS)),
+        logger_("exchange_market_data_publisher.log"),
+        incremental_socket_(logger_, {.num_slots_ = MDP_MAX_BATCH_DATAGRAMS, .slot_size_ = max_datagram_size,
+            .kernel_buffer_size_ = MDP_SNDBUF_SIZE})
+        {
+            ASSERT(!outgoing_md_updates_.empty(), "MarketDataPublisher needs at least one MEMarketUpdateLFQueue.");
+            ASSERT(max_datagram_size_ >= sizeof(MDPMarketUpdate),
+                "MarketDataPublisher datagrams must hold at least one MDPMarketUpdate.");
+            ASSERT(incremental_socket_.init(incremental_ip, iface, incremental_port, false) >= 0,
+                "Unable to create incremental mcast socket. error:" + std::string(std::strerror(errno)));
+
+            snapshot_synthesizer_ = new SnapshotSynthesizer(&snapshot_md_updates_, iface, snapshot_ip, snapshot_port,
+                max_datagram_size_);
+        }
+
+    MarketDataPublisher::~MarketDataPublisher() {
+        stop();
+
+        using namespace std::literals::chrono_literals;
+        std::this_thread::sleep_for(1s);
+
+        delete snapshot_synthesizer_;
+        snapshot_synthesizer_ = nullptr;
+    }
+
+    auto MarketDataPublisher::start() -> void {
+        run_ = true;
+        snapshot_synthesizer_ -> start();
+
+        ASSERT(createAndStartThread(-1, "Exchange/MarketDataPublisher", [this] { run(); }) != nullptr,
+            "Failed to start MarketData thread.");
+    }
+
+    auto MarketDataPublisher::stop() -> void {
+        run_ = false;
+        snapshot_synthesizer_ -> stop();
+    }
+}
@@ -3,25 +3,136 @@
 #ifndef TRADINGECOSYSTEM_MARKET_DATA_PUBLISHER_H
 #define TRADINGECOSYSTEM_MARKET_DATA_PUBLISHER_H
 
+#include <vector>
 #include <functional>
 
 #include "market_update.h"
 #include "low-latency-components/logging.h"
+#include "low-latency-components/time_utils.h"
+#include "low-latency-components/thread_utils.h"
 #include "low-latency-components/mcast_socket.h"
 #include "exchange/market_data/snapshot_synthesizer.h"
 
 namespace Exchange {
+    /** Largest UDP payload that fits a 1500 byte Ethernet MTU without IP fragmentation. */
+    constexpr size_t MDP_MAX_DATAGRAM_SIZE = 1500 - 20 - 8;
+    /** Longest an update waits in a partially filled datagram. */
+    constexpr Nanos MDP_BATCH_BUDGET = 10 * NANOS_TO_MICROS;
+    /** Most datagrams handed to the kernel by one sendmmsg(). */
+    constexpr size_t MDP_MAX_BATCH_DATAGRAMS = 64;
+    /** Kernel send buffer asked for, room for several full batches. */
+    constexpr int MDP_SNDBUF_SIZE = 16 * 1024 * 1024;
+
+    /**
+     * Drains the matching engine(s) market updates, numbers them with one incremental sequence and multicasts
+     * them as back to back MDPMarketUpdates, as many per datagram as fit in max_datagram_size.
+     * A datagram is ended when the next update would not fit, and ended datagrams queue up in the socket's slots
+     * while the queues are drained and go out together, one sendmmsg() per pass rather than one send() per update.
+     * A partially filled datagram goes out once its first update has waited batch_budget.
+     * Every published update is also handed to a SnapshotSynthesizer, which serves the snapshot stream.
+     */
     class MarketDataPublisher {
+    public:
+        MarketDataPublisher(MEMarketUpdateLFQueue *market_updates, const std::string &iface,
+            const std::string &incremental_ip, int incremental_port,
+            const std::string &snapshot_ip, int snapshot_port,
+            size_t max_datagram_size = MDP_MAX_DATAGRAM_SIZE, Nanos batch_budget = MDP_BATCH_BUDGET);
+        /** Sharded mode, one queue per matching engine shard, all published on the same incremental stream. */
+        MarketDataPublisher(const std::vector<MEMarketUpdateLFQueue *> &market_updates, const std::string &iface,
+            const std::string &incremental_ip, int incremental_port,
+            const std::string &snapshot_ip, int snapshot_port,
+            size_t max_datagram_size = MDP_MAX_DATAGRAM_SIZE, Nanos batch_budget = MDP_BATCH_BUDGET);
+        ~MarketDataPublisher();
+
+        auto start() -> void;
+        auto stop()  -> void;
+
+        /**
+         * Numbers market_update and folds it straight into the snapshot image without multicasting it.
+         * Used while the books are rebuilt from the journal before start(), so the incremental stream resumes
+         * after the replayed sequence and consumers pick the rebuilt books up from the first snapshot.
+         */
+        auto replayMarketUpdate(const MEMarketUpdate &market_update) -> void {
+            const MDPMarketUpdate mdp_market_update{next_inc_seq_num_++, market_update};
+            snapshot_synthesizer_ -> addToSnapshot(&mdp_market_update);
+        }
+
+        auto run() noexcept {
+            logger_.log("%:% %() %.\n",
+                __FILE__, __LINE__, __func__,
+                getCurrentTimeStr(&time_str_));
+
+            while (run_) {
+                for (const auto outgoing_md_updates : outgoing_md_updates_) {
+                    const auto market_updates = outgoing_md_updates -> peek();
+                    for (const auto &market_update : market_updates)
+                        publish(market_update);
+                    outgoing_md_updates -> consume(market_updates.size());
+                }
+
+                if (datagram_size_ && TSCClock::ticks() - datagram_start_ticks_ >= batch_budget_ticks_)
+                    flush();
+                else if (incremental_socket_.pendingDatagrams())
+                    incremental_socket_.sendDatagrams();
+            }
+            flush();
+        }
+
+        MarketDataPublisher() = delete;
+        MarketDataPublisher(const MarketDataPublisher & ) = delete;
+        MarketDataPublisher(const MarketDataPublisher &&) = delete;
+        MarketDataPublisher &operator = (const MarketDataPublisher & ) = delete;
+        MarketDataPublisher &operator = (const MarketDataPublisher &&) = delete;
+
     private:
         size_t next_inc_seq_num_ = 1;
-        MEMarketUpdateLFQueue *outgoing_md_updates_ = nullptr;
+        std::vector<MEMarketUpdateLFQueue *> outgoing_md_updates_;
         MDPMarketUpdateLFQueue snapshot_md_updates_;
+        const size_t max_datagram_size_ = MDP_MAX_DATAGRAM_SIZE;
+        const uint64_t batch_budget_ticks_ = 0;
+        size_t datagram_size_ = 0;
+        size_t datagram_first_seq_num_ = 0;
+        uint64_t datagram_start_ticks_ = 0;
         volatile bool run_ = false;
         std::string time_str_;
         Logger logger_;
         McastSocket incremental_socket_;
         SnapshotSynthesizer *snapshot_synthesizer_ = nullptr;
+
+        auto publish(const MEMarketUpdate &market_update) noexcept -> void {
+            if (UNLIKELY(datagram_size_ + sizeof(MDPMarketUpdate) > max_datagram_size_))
+                endDatagram();
+            if (!datagram_size_) {
+                datagram_start_ticks_ = TSCClock::ticks();
+                datagram_first_seq_num_ = next_inc_seq_num_;
+            }
+
+            const MDPMarketUpdate mdp_market_update{next_inc_seq_num_++, market_update};
+            incremental_socket_.send(&mdp_market_update, sizeof(MDPMarketUpdate));
+            datagram_size_ += sizeof(MDPMarketUpdate);
+
+            *snapshot_md_updates_.getNextToWriteTo() = mdp_market_update;
+            snapshot_md_updates_.updateWriteIndex();
+        }
+
+        auto endDatagram() noexcept -> void {
+            if (!datagram_size_)
+                return;
+            logger_.log("%:% %() % Sending seq: % to % in % bytes. \n",
+                __FILE__, __LINE__, __func__,
+                getCurrentTimeStr(&time_str_),
+                datagram_first_seq_num_,
+                next_inc_seq_num_ - 1,
+                datagram_size_);
+            incremental_socket_.endDatagram();
+            datagram_size_ = 0;
+        }
+
+        auto flush() noexcept -> void {
+            endDatagram();
+            incremental_socket_.flush();
+        }
     };
 }
 
-#endif //TRADINGECOSYSTEM_MARKET_DATA_PUBLISHER_H
\ No newline at end of file
+#endif //TRADINGECOSYSTEM_MARKET_DATA_PUBLISHER_H
@@ -0,0 +1,217 @@
+#include "snapshot_synthesizer.h"
+#include "low-latency-components/thread_utils.h"
+
+namespace Exchange {
+    SnapshotSynthesizer::SnapshotSynthesizer(
+        MDPMarketUpdateLFQueue *market_updates,
+        const std::string &iface,
+        const std::string &snapshot_ip,
+        const int snapshot_port,
+        const size_t max_datagram_size,
+        const Nanos snapshot_interval) :
+        snapshot_md_updates_(market_updates),
+        logger_("exchange_snapshot_synthesizer.log"),
+        snapshot_socket_(logger_, {.num_slots_ = MDP_MAX_SNAPSHOT_BATCH_DATAGRAMS, .slot_size_ = max_datagram_size,
+            .kernel_buffer_size_ = MDP_SNAPSHOT_SNDBUF_SIZE}),
+        max_datagram_size_(max_datagram_size),
+        orders_(ME_MAX_LIVE_ORDERS),
+        order_pool_(ME_MAX_LIVE_ORDERS),
+        snapshot_interval_(snapshot_interval)
+        {
+            ASSERT(max_datagram_size_ >= sizeof(MDPMarketUpdate),
+                "SnapshotSynthesizer datagrams must hold at least one MDPMarketUpdate.");
+            ASSERT(snapshot_socket_.init(snapshot_ip, iface, snapshot_port, false) >= 0,
+                "Unable to create snapshot mcast socket. error:" + std::string(std::strerror(errno)));
+        }
+
+    SnapshotSynthesizer::~SnapshotSynthesizer() {
+        stop();
+
+        using namespace std::literals::chrono_literals;
+        std::this_thread::sleep_for(1s);
+
+        for (TickerId ticker_id = 0; ticker_id < ticker_orders_.size(); ++ticker_id)
+            clearTicker(ticker_id);
+    }
+
+    auto SnapshotSynthesizer::start() -> void {
+        run_ = true;
+        ASSERT(createAndStartThread(-1, "Exchange/SnapshotSynthesizer", [this] { run(); }) != nullptr,
+            "Failed to start SnapshotSynthesizer thread.");
+    }
+
+    auto SnapshotSynthesizer::stop() -> void {
+        run_ = false;
+    }
+
+    auto SnapshotSynthesizer::run() -> void {
+        logger_.log("%:% %() %\n",
+            __FILE__, __LINE__, __func__,
+            getCurrentTimeStr(&time_str_));
+
+        last_snapshot_time_ = getCurrentNanos();
+        while (run_) {
+            const auto market_updates = snapshot_md_updates_ -> peek();
+            for (const auto &market_update : market_updates)
+                addToSnapshot(&market_update);
+            snapshot_md_updates_ -> consume(market_updates.size());
+
+            if (getCurrentNanos() - last_snapshot_time_ >= snapshot_interval_) {
+                last_snapshot_time_ = getCurrentNanos();
+                publishSnapshot();
+            }
+        }
+    }
+
+    /** Folds one incremental update into the image, the stream must arrive gap free. */
+    auto SnapshotSynthesizer::addToSnapshot(const MDPMarketUpdate *market_update) -> void {
+        const auto &me_market_update = market_update -> me_market_update_;
+        if (UNLIKELY(market_update -> seq_num_ != last_inc_seq_num_ + 1)) {
+            FATAL("Expected incremental seq_nums to increase. last: " + std::to_string(last_inc_seq_num_) +
+                " " + market_update -> toString());
+        }
+        if (UNLIKELY(me_market_update.ticker_id_ >= ticker_orders_.size())) {
+            FATAL("Market update for unknown ticker: " + market_update -> toString());
+        }
+
+        const SnapshotOrderKey key{me_market_update.ticker_id_, me_market_update.order_id_};
+        switch (me_market_update.type_) {
+            case MEMarketUpdateType::ADD: {
+                if (UNLIKELY(orders_.find(key) != nullptr))
+                    FATAL("Received ADD for an order that is already live: " + market_update -> toString());
+
+                const auto order = order_pool_.allocate(SnapshotOrder{me_market_update, nullptr, nullptr});
+                orders_.insert(key, order);
+                linkOrder(order);
+            }
+                break;
+            case MEMarketUpdateType::MODIFY: {
+                const auto itr = orders_.find(key);
+                if (UNLIKELY(itr == nullptr))
+                    FATAL("Received MODIFY for an unknown order: " + market_update -> toString());
+
+                const auto order = *itr;
+                const auto lost_priority = order -> order_.price_ != me_market_update.price_ ||
+                    order -> order_.priority_ != me_market_update.priority_;
+                order -> order_.price_ = me_market_update.price_;
+                order -> order_.qty_ = me_market_update.qty_;
+                order -> order_.priority_ = me_market_update.priority_;
+
+                /** An amend that moved the order to the back of a queue moves it to the back of the image too. */
+                if (lost_priority) {
+                    unlinkOrder(order);
+                    linkOrder(order);
+                }
+            }
+                break;
+            case MEMarketUpdateType::CANCEL: {
+                const auto itr = orders_.find(key);
+                if (UNLIKELY(itr == nullptr))
+                    FATAL("Received CANCEL for an unknown order: " + market_update -> toString());
+
+                const auto order = *itr;
+                unlinkOrder(order);
+                orders_.erase(key);
+                order_pool_.deallocate(order);
+            }
+                break;
+            case MEMarketUpdateType::CLEAR:
+                clearTicker(me_market_update.ticker_id_);
+                break;
+            case MEMarketUpdateType::TRADE:
+            case MEMarketUpdateType::SNAPSHOT_START:
+            case MEMarketUpdateType::SNAPSHOT_END:
+            case MEMarketUpdateType::INVALID:
+                break;
+        }
+
+        last_inc_seq_num_ = market_update -> seq_num_;
+    }
+
+    /** Publishes the whole image as one SNAPSHOT_START ... SNAPSHOT_END cycle. */
+    auto SnapshotSynthesizer::publishSnapshot() -> void {
+        size_t snapshot_size = 0;
+
+        const MEMarketUpdate start_market_update{MEMarketUpdateType::SNAPSHOT_START, last_inc_seq_num_};
+        sendSnapshotUpdate(snapshot_size++, start_market_update);
+
+        for (TickerId ticker_id = 0; ticker_id < ticker_orders_.size(); ++ticker_id) {
+            MEMarketUpdate clear_market_update;
+            clear_market_update.type_ = MEMarketUpdateType::CLEAR;
+            clear_market_update.ticker_id_ = ticker_id;
+            sendSnapshotUpdate(snapshot_size++, clear_market_update);
+
+            if (const auto head = ticker_orders_[ticker_id]) {
+                auto order = head;
+                do {
+                    sendSnapshotUpdate(snapshot_size++, order -> order_);
+                    order = order -> next_order_;
+                } while (order != head);
+            }
+        }
+
+        const MEMarketUpdate end_market_update{MEMarketUpdateType::SNAPSHOT_END, last_inc_seq_num_};
+        sendSnapshotUpdate(snapshot_size++, end_market_update);
+        snapshot_socket_.flush();
+        datagram_size_ = 0;
+        /** Off the hot path, so wait for the kernel to take the whole cycle: one lost datagram spoils it for every consumer. */
+        while (snapshot_socket_.pendingDatagrams()) {
+            std::this_thread::yield();
+            snapshot_socket_.sendDatagrams();
+        }
+
+        logger_.log("%:% %() % Published snapshot of % orders in % messages up to inc seq: %.\n",
+            __FILE__, __LINE__, __func__,
+            getCurrentTimeStr(&time_str_),
+            orders_.size(),
+            snapshot_size,
+            last_inc_seq_num_);
+    }
+
+    /** Appends order at the tail of its ticker's circular list. */
+    auto SnapshotSynthesizer::linkOrder(SnapshotOrder *order) noexcept -> void {
+        auto &head = ticker_orders_[order -> order_.ticker_id_];
+        if (!head) {
+            order -> prev_order_ = order -> next_order_ = order;
+            head = order;
+            return;
+        }
+        order -> prev_order_ = head -> prev_order_;
+        order -> next_order_ = head;
+        head -> prev_order_ -> next_order_ = order;
+        head -> prev_order_ = order;
+    }
+
+    auto SnapshotSynthesizer::unlinkOrder(SnapshotOrder *order) noexcept -> void {
+        auto &head = ticker_orders_[order -> order_.ticker_id_];
+        if (order -> next_order_ == order) {
+            head = nullptr;
+        }
+        else {
+            order -> prev_order_ -> next_order_ = order -> next_order_;
+            order -> next_order_ -> prev_order_ = order -> prev_order_;
+            if (head == order)
+                head = order -> next_order_;
+        }
+        order -> prev_order_ = order -> next_order_ = nullptr;
+    }
+
+    auto SnapshotSynthesizer::clearTicker(const TickerId ticker_id) noexcept -> void {
+        while (const auto order = ticker_orders_[ticker_id]) {
+            unlinkOrder(order);
+            orders_.erase({ticker_id, order -> order_.order_id_});
+            order_pool_.deallocate(order);
+        }
+    }
+
+    /** Packs market_update into the current datagram, ending it first if it is full. */
+    auto SnapshotSynthesizer::sendSnapshotUpdate(const size_t seq_num, const MEMarketUpdate &market_update) noexcept -> void {
+        if (datagram_size_ + sizeof(MDPMarketUpdate) > max_datagram_size_) {
+            snapshot_socket_.endDatagram();
+            datagram_size_ = 0;
+        }
+        const MDPMarketUpdate mdp_market_update{seq_num, market_update};
+        snapshot_socket_.send(&mdp_market_update, sizeof(MDPMarketUpdate));
+        datagram_size_ += sizeof(MDPMarketUpdate);
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#ifndef TRADINGECOSYSTEM_SNAPSHOT_SYNTHESIZER_H
+#define TRADINGECOSYSTEM_SNAPSHOT_SYNTHESIZER_H
+
+#include <array>
+
+#include "market_update.h"
+#include "low-latency-components/logging.h"
+#include "low-latency-components/mem_pool.h"
+#include "low-latency-components/hash_map.h"
+#include "low-latency-components/time_utils.h"
+#include "low-latency-components/mcast_socket.h"
+
+namespace Exchange {
+    /** How often a full snapshot cycle is published. */
+    constexpr Nanos MDP_SNAPSHOT_INTERVAL = 60 * NANOS_TO_SECS;
+    /** Most snapshot datagrams handed to the kernel by one sendmmsg(). */
+    constexpr size_t MDP_MAX_SNAPSHOT_BATCH_DATAGRAMS = 256;
+    /** Kernel send buffer asked for, a snapshot cycle goes out as one burst. */
+    constexpr int MDP_SNAPSHOT_SNDBUF_SIZE = 64 * 1024 * 1024;
+
+    /** One live order in the snapshot image, linked into its ticker's list in the order it was added. */
+    struct SnapshotOrder {
+        MEMarketUpdate order_;
+        SnapshotOrder *prev_order_ = nullptr;
+        SnapshotOrder *next_order_ = nullptr;
+    };
+
+    /** Market order ids are only unique within a ticker's book. */
+    struct SnapshotOrderKey {
+        TickerId ticker_id_ = TickerId_INVALID;
+        OrderId order_id_ = OrderId_INVALID;
+
+        auto operator == (const SnapshotOrderKey &rhs) const noexcept -> bool {
+            return ticker_id_ == rhs.ticker_id_ && order_id_ == rhs.order_id_;
+        }
+    };
+
+    struct SnapshotOrderKeyHash {
+        auto operator () (const SnapshotOrderKey &key) const noexcept -> size_t {
+            return mixHash(key.order_id_ ^ static_cast<uint64_t>(key.ticker_id_) << 48);
+        }
+    };
+
+    typedef RobinHoodHashMap< SnapshotOrderKey, SnapshotOrder *, SnapshotOrderKeyHash > SnapshotOrderHashMap;
+
+    /**
+     * Replays the incremental stream the MarketDataPublisher sent into a market-by-order image of every ticker
+     * and every snapshot_interval multicasts the whole image on the snapshot stream as
+     * SNAPSHOT_START, then per ticker a CLEAR followed by an ADD per live order, then SNAPSHOT_END.
+     * SNAPSHOT_START and SNAPSHOT_END carry the last incremental seq_num_ folded into the image in order_id_,
+     * so a consumer that joins late or detects a gap rebuilds from the snapshot and resumes the incremental
+     * stream right after it, without involving the matching engine.
+     * Snapshot messages are numbered from 0 in every cycle and packed into datagrams like the incremental stream.
+     */
+    class SnapshotSynthesizer {
+    public:
+        SnapshotSynthesizer(MDPMarketUpdateLFQueue *market_updates, const std::string &iface,
+            const std::string &snapshot_ip, int snapshot_port,
+            size_t max_datagram_size, Nanos snapshot_interval = MDP_SNAPSHOT_INTERVAL);
+        ~SnapshotSynthesizer();
+
+        auto start() -> void;
+        auto stop()  -> void;
+
+        auto addToSnapshot(const MDPMarketUpdate *market_update) -> void;
+        auto publishSnapshot() -> void;
+
+        auto run() -> void;
+
+        SnapshotSynthesizer() = delete;
+        SnapshotSynthesizer(const SnapshotSynthesizer & ) = delete;
+        SnapshotSynthesizer(const SnapshotSynthesizer &&) = delete;
+        SnapshotSynthesizer &operator = (const SnapshotSynthesizer & ) = delete;
+        SnapshotSynthesizer &operator = (const SnapshotSynthesizer &&) = delete;
+
+    private:
+        MDPMarketUpdateLFQueue *snapshot_md_updates_ = nullptr;
+        Logger logger_;
+        volatile bool run_ = false;
+        std::string time_str_;
+
+        McastSocket snapshot_socket_;
+        const size_t max_datagram_size_;
+        size_t datagram_size_ = 0;
+
+        /** Head of each ticker's list of live orders. */
+        std::array<SnapshotOrder *, ME_MAX_TICKERS> ticker_orders_ = {};
+        /** Every book's resting orders, at most ME_MAX_LIVE_ORDERS as the matching engine enforces. */
+        SnapshotOrderHashMap orders_;
+        MemPool<SnapshotOrder> order_pool_;
+
+        size_t last_inc_seq_num_ = 0;
+        const Nanos snapshot_interval_;
+        Nanos last_snapshot_time_ = 0;
+
+        auto linkOrder(SnapshotOrder *order) noexcept -> void;
+        auto unlinkOrder(SnapshotOrder *order) noexcept -> void;
+        auto clearTicker(TickerId ticker_id) noexcept -> void;
+        auto sendSnapshotUpdate(size_t seq_num, const MEMarketUpdate &market_update) noexcept -> void;
+    };
+}
+
+#endif //TRADINGECOSYSTEM_SNAPSHOT_SYNTHESIZER_H
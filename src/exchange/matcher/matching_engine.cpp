@@ -4,15 +4,25 @@ namespace Exchange {
     MatchingEngine::MatchingEngine(
         ClientRequestLFQueue *client_requests,
         MEClientResponseLFQueue *client_responses,
-        MEMarketUpdateLFQueue *market_updates
+        MEMarketUpdateLFQueue *market_updates,
+        const size_t shard_id,
+        const size_t num_shards,
+        const int core_id
         ) :
+    shard_id_( shard_id ),
+    core_id_( core_id ),
     incoming_requests_( client_requests ),
     outgoing_ogw_responses_( client_responses ),
     outgoing_md_updates_( market_updates ),
-    logger_("exchange_matching_engine.log")
+    logger_(num_shards == 1 ? "exchange_matching_engine.log" : "exchange_matching_engine_" + std::to_string(shard_id) + ".log")
     {
         for ( size_t i = 0; i < ticker_order_book_.size(); ++i ) {
-            ticker_order_book_[i] = new MEOrderBook(i, &logger_, this);
+            if (tickerIdToShard(i, num_shards) == shard_id_)
+                ticker_order_book_[i] = new MEOrderBook(i, &logger_, this);
+        }
+        if constexpr (LATENCY_PROBES_ENABLED) {
+            request_probes_ = LatencyProbes::instance().probesFor(client_requests);
+            response_probes_ = LatencyProbes::instance().probesFor(client_responses);
         }
     }
 
@@ -23,8 +33,6 @@ namespace Exchange {
         std::this_thread::sleep_for(1s);
 
         incoming_requests_ = nullptr;
-        outgoing_ogw_responses_ = nullptr;
-        outgoing_md_updates_ = nullptr;
 
         for ( auto& order_book : ticker_order_book_ ) {
             delete order_book;
@@ -34,7 +42,7 @@ namespace Exchange {
 
     auto MatchingEngine::start() -> void {
         run_ = true;
-        ASSERT(createAndStartThread(-1, "Exchange/MatchingEngine", [this]{ run(); }) != nullptr,
+        ASSERT(createAndStartThread(core_id_, "Exchange/MatchingEngine/" + std::to_string(shard_id_), [this]{ run(); }) != nullptr,
             "Failed to start MatchingEngine thread.");
     }
 
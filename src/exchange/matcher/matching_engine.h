@@ -6,6 +6,7 @@
 #include "me_order_book.h"
 #include "low-latency-components/macros.h"
 #include "low-latency-components/logging.h"
+#include "low-latency-components/latency_probes.h"
 #include "exchange/market_data/market_update.h"
 #include "exchange/order_server/client_request.h"
 #include "exchange/order_server/client_response.h"
@@ -14,17 +15,44 @@
 namespace Exchange {
     class MatchingEngine final {
     public:
+        /** Owns the books of the tickers that map to shard_id out of num_shards, its thread is pinned to core_id. */
         MatchingEngine(
             ClientRequestLFQueue *client_requests,
             MEClientResponseLFQueue *client_responses,
-            MEMarketUpdateLFQueue *market_updates
+            MEMarketUpdateLFQueue *market_updates,
+            size_t shard_id = 0,
+            size_t num_shards = 1,
+            int core_id = -1
             );
         ~MatchingEngine();
 
         auto start() -> void;
         auto stop()  -> void;
 
-         auto processClientRequest(const MEClientRequest *client_request) const noexcept{
+        /**
+         * Everything sent while processing one request is published as a single burst once it has been handled.
+         * The gateway, the sequencer and journal replay drop requests failing isValidClientRequest(), so the FATALs
+         * below cannot happen.
+         */
+        auto processClientRequest(const MEClientRequest *client_request) noexcept {
+            if constexpr (LATENCY_PROBES_ENABLED)
+                current_probe_.engine_entry_ = TSCClock::ticks();
+            if (UNLIKELY(client_request -> client_id_ >= ME_MAX_NUM_CLIENTS)) {
+                FATAL("Received client-request for invalid client: " + client_request -> toString());
+            }
+            if (client_request -> type_ == ClientRequestType::MASS_CANCEL &&
+                client_request -> ticker_id_ == TickerId_INVALID) {
+                /** Mass cancel over every ticker, each shard receives it and cancels in the books it owns. */
+                for (const auto order_book : ticker_order_book_) {
+                    if (order_book)
+                        order_book -> massCancel(client_request -> client_id_, order_book -> tickerId());
+                }
+                publish();
+                return;
+            }
+            if (UNLIKELY(client_request -> ticker_id_ >= ticker_order_book_.size() || !ticker_order_book_[client_request -> ticker_id_])) {
+                FATAL("Received client-request for ticker not owned by this engine: " + client_request -> toString());
+            }
             const auto order_book = ticker_order_book_[client_request -> ticker_id_];
             switch (client_request -> type_) {
                 case ClientRequestType::NEW: {
@@ -44,31 +72,46 @@ namespace Exchange {
                         client_request -> ticker_id_);
                 } break;
 
+                case ClientRequestType::MODIFY: {
+                    order_book -> modify(
+                        client_request -> client_id_,
+                        client_request -> order_id_,
+                        client_request -> ticker_id_,
+                        client_request -> price_,
+                        client_request -> qty_);
+                } break;
+
+                case ClientRequestType::MASS_CANCEL: {
+                    order_book -> massCancel(
+                        client_request -> client_id_,
+                        client_request -> ticker_id_);
+                } break;
+
                 default: {
                     FATAL("Received invalid client-request-type: " +
                         clientRequestTypeToString(client_request -> type_ ));
                 } break;
             }
+            publish();
         }
 
         auto sendClientResponse(const MEClientResponse *client_response) noexcept {
             logger_.log("%:% %() % Sending: %. \n.",
                 __FILE__, __LINE__, __func__,
                 getCurrentTimeStr( &time_str_ ),
-                client_response -> toString());
-            const auto next_write = outgoing_ogw_responses_ -> getNextToWriteTo();
-            *next_write = *client_response;
-            outgoing_ogw_responses_ -> updateWriteIndex();
+                *client_response);
+            const auto slot = outgoing_ogw_responses_.next();
+            *slot = *client_response;
+            if constexpr (LATENCY_PROBES_ENABLED)
+                response_probes_[outgoing_ogw_responses_.queue() -> indexOf(slot)] = current_probe_;
         }
 
         auto sendMarketUpdate(const MEMarketUpdate *market_update) noexcept {
             logger_.log("%:% %() % Sending: %. \n",
                 __FILE__, __LINE__, __func__,
                 getCurrentTimeStr( &time_str_ ),
-                market_update -> toString());
-            const auto next_write = outgoing_md_updates_ -> getNextToWriteTo();
-            *next_write = *market_update;
-            outgoing_md_updates_ -> updateWriteIndex();
+                *market_update);
+            *outgoing_md_updates_.next() = *market_update;
         }
 
         auto run() noexcept {
@@ -76,15 +119,18 @@ namespace Exchange {
                 getCurrentTimeStr( &time_str_ ));
 
             while ( run_ ) {
-                if (const auto me_client_request = incoming_requests_ -> getNextToRead()) {
+                const auto me_client_requests = incoming_requests_ -> peek();
+                for (const auto &me_client_request : me_client_requests) {
                     logger_.log("%:% %() % Processing %. \n",
                         __FILE__, __LINE__, __func__,
                         getCurrentTimeStr( &time_str_ ),
-                        me_client_request -> toString());
+                        me_client_request);
 
-                    processClientRequest(me_client_request);
-                    incoming_requests_ -> updateReadIndex();
+                    if constexpr (LATENCY_PROBES_ENABLED)
+                        current_probe_ = request_probes_[incoming_requests_ -> indexOf(&me_client_request)];
+                    processClientRequest(&me_client_request);
                 }
+                incoming_requests_ -> consume(me_client_requests.size());
             }
         }
 
@@ -96,12 +142,38 @@ namespace Exchange {
 
     private:
         OrderBookHashMap ticker_order_book_ = {};
+        const size_t shard_id_ = 0;
+        const int core_id_ = -1;
         ClientRequestLFQueue *incoming_requests_ = nullptr;
-        MEClientResponseLFQueue *outgoing_ogw_responses_ = nullptr;
-        MEMarketUpdateLFQueue *outgoing_md_updates_ = nullptr;
+        LFQueueBatchWriter<MEClientResponse> outgoing_ogw_responses_;
+        LFQueueBatchWriter<MEMarketUpdate> outgoing_md_updates_;
         volatile bool run_ = false;
         std::string time_str_;
         Logger logger_;
+
+        /** Latency probe side tables of the request / response queues, null when probes are compiled out. */
+        RequestProbe *request_probes_ = nullptr;
+        RequestProbe *response_probes_ = nullptr;
+        /** Probe of the request being processed, copied onto every response it produces. */
+        RequestProbe current_probe_;
+
+        /**
+         * Publishes the burst of the request just processed. Responses still pending get its exit time, the ones
+         * next() already had to publish mid-burst keep engine_exit_ = 0 and are left out of that stage.
+         */
+        auto publish() noexcept -> void {
+            if constexpr (LATENCY_PROBES_ENABLED) {
+                current_probe_.engine_exit_ = TSCClock::ticks();
+                auto &probes = LatencyProbes::instance();
+                probes.recordTicks(ProbeStage::SEQUENCED_TO_ENGINE_ENTRY, current_probe_.sequenced_, current_probe_.engine_entry_);
+                probes.recordTicks(ProbeStage::ENGINE_ENTRY_TO_EXIT, current_probe_.engine_entry_, current_probe_.engine_exit_);
+                for (const auto &client_response : outgoing_ogw_responses_.pending())
+                    response_probes_[outgoing_ogw_responses_.queue() -> indexOf(&client_response)].engine_exit_ = current_probe_.engine_exit_;
+                current_probe_ = {};
+            }
+            outgoing_ogw_responses_.publish();
+            outgoing_md_updates_.publish();
+        }
     };
 }
 
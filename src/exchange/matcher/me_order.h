@@ -6,6 +6,7 @@
 #include <array>
 #include <sstream>
 #include "low-latency-components/types.h"
+#include "low-latency-components/hash_map.h"
 
 using namespace Common;
 
@@ -21,6 +22,9 @@ namespace Exchange {
         Priority priority_ = Priority_INVALID;
         MEOrder *prev_order_ = nullptr;
         MEOrder *next_order_ = nullptr;
+        /** Intrusive list of the same client's live orders in this book, nullptr terminated. */
+        MEOrder *prev_client_order_ = nullptr;
+        MEOrder *next_client_order_ = nullptr;
 
         /** Only needed for use with MemPool */
         MEOrder() = default;
@@ -53,8 +57,23 @@ namespace Exchange {
         auto toString() const -> std::string;
     };
 
-    typedef std::array< MEOrder *, ME_MAX_ORDER_IDS > OrderHashMap;
-    typedef std::array< OrderHashMap, ME_MAX_NUM_CLIENTS > ClientOrderHashMap;
+    struct ClientOrderKey {
+        ClientId client_id_ = ClientId_INVALID;
+        OrderId client_order_id_ = OrderId_INVALID;
+
+        auto operator == (const ClientOrderKey &rhs) const noexcept -> bool {
+            return client_id_ == rhs.client_id_ && client_order_id_ == rhs.client_order_id_;
+        }
+    };
+
+    struct ClientOrderKeyHash {
+        auto operator () (const ClientOrderKey &key) const noexcept -> size_t {
+            return mixHash(key.client_order_id_ ^ (static_cast<uint64_t>(key.client_id_) << 40 | key.client_id_));
+        }
+    };
+
+    /** Live orders by (client_id, client_order_id), sized for ME_EXPECTED_LIVE_ORDERS live orders per book and grown past that. */
+    typedef RobinHoodHashMap< ClientOrderKey, MEOrder *, ClientOrderKeyHash > ClientOrderHashMap;
 
     struct MEOrdersAtPrice {
         Side side_ = Side::INVALID;
@@ -62,23 +81,16 @@ namespace Exchange {
 
         MEOrder *first_me_order_ = nullptr;
 
-        MEOrdersAtPrice *prev_entry_ = nullptr;
-        MEOrdersAtPrice *next_entry_ = nullptr;
-
         MEOrdersAtPrice() = default;
 
         MEOrdersAtPrice(
             const Side side,
             const Price price,
-            MEOrder *first_me_order,
-            MEOrdersAtPrice *prev_entry,
-            MEOrdersAtPrice * next_entry ) :
+            MEOrder *first_me_order) :
 
             side_( side ),
             price_( price ),
-            first_me_order_( first_me_order ),
-            prev_entry_( prev_entry ),
-            next_entry_( next_entry )
+            first_me_order_( first_me_order )
         {}
 
         [[nodiscard]]
@@ -89,14 +101,10 @@ namespace Exchange {
                 << " Side: " << sideToString( side_ )
                 << " Price: " << priceToString( price_ )
                 << " First ME Order: " << ( first_me_order_ ? first_me_order_ -> toString() : "null" )
-                << " Prev: " << priceToString( prev_entry_ ? prev_entry_ -> price_ : Price_INVALID )
-                << " Next: " << priceToString( next_entry_ ? next_entry_ -> price_ : Price_INVALID )
                 << " ] ";
             return ss.str();
         }
     };
-
-    typedef std::array<MEOrdersAtPrice *, ME_MAX_PRICE_LEVELS> OrdersAtPriceHashMap;
 }
 
 
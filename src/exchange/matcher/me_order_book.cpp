@@ -8,8 +8,8 @@ namespace Exchange {
         MatchingEngine * matching_engine) :
         ticker_id_(ticker_id),
         matching_engine_(matching_engine),
-        orders_at_price_pool_(ME_MAX_PRICE_LEVELS),
-        order_pool_(ME_MAX_ORDER_IDS),
+        cid_oid_to_order_(ME_EXPECTED_LIVE_ORDERS),
+        order_pool_(ME_MAX_LIVE_ORDERS_PER_TICKER),
         logger_(logger)
     {}
 
@@ -20,10 +20,7 @@ namespace Exchange {
             toString(false, true));
 
         matching_engine_ = nullptr;
-        bids_at_price_ = asks_at_price_ = nullptr;
-        for (auto &itr : cid_oid_to_order_) {
-            itr.fill(nullptr);
-        }
+        cid_oid_to_order_.clear();
     }
 
     auto MEOrderBook::match(const TickerId ticker_id, const ClientId client_id, const Side side, const OrderId client_order_id, const OrderId new_market_order_id, MEOrder* itr, Qty* leaves_qty) noexcept {
@@ -102,8 +99,9 @@ namespace Exchange {
         auto leaves_qty = qty;
 
         if (side == Side::BUY) {
-            while (leaves_qty && asks_at_price_) {
-                const auto ask_itr = asks_at_price_ -> first_me_order_;
+            for (auto asks_at_price = price_ladder_.getBestOrdersAtPrice(Side::SELL); leaves_qty && asks_at_price;
+                 asks_at_price = price_ladder_.getBestOrdersAtPrice(Side::SELL)) {
+                const auto ask_itr = asks_at_price -> first_me_order_;
                 if (price < ask_itr -> price_) {
                     break;
                 }
@@ -111,8 +109,9 @@ namespace Exchange {
             }
         }
         if (side == Side::SELL) {
-            while (leaves_qty && bids_at_price_) {
-                const auto bid_itr = bids_at_price_ -> first_me_order_;
+            for (auto bids_at_price = price_ladder_.getBestOrdersAtPrice(Side::BUY); leaves_qty && bids_at_price;
+                 bids_at_price = price_ladder_.getBestOrdersAtPrice(Side::BUY)) {
+                const auto bid_itr = bids_at_price -> first_me_order_;
                 if (price > bid_itr -> price_) {
                     break;
                 }
@@ -136,7 +135,26 @@ namespace Exchange {
             qty
         };
         matching_engine_ -> sendClientResponse(&client_response_);
-        if (const auto leaves_qty = checkForMatch(client_id, client_order_id, ticker_id, side, price, qty, new_market_order_id)) {
+        const auto leaves_qty = checkForMatch(client_id, client_order_id, ticker_id, side, price, qty, new_market_order_id);
+        if (leaves_qty && UNLIKELY(order_pool_.inUse() == order_pool_.capacity() || !price_ladder_.makeRoomFor(price))) {
+            /**
+             * The book already holds ME_MAX_LIVE_ORDERS_PER_TICKER resting orders, or the remainder would rest further
+             * from the book than the price ladder spans, so it is not booked.
+             */
+            client_response_ = {
+                ClientResponseType::CANCELED,
+                client_id,
+                ticker_id,
+                client_order_id,
+                new_market_order_id,
+                side,
+                price,
+                Qty_INVALID,
+                leaves_qty
+            };
+            matching_engine_ -> sendClientResponse(&client_response_);
+        }
+        else if (leaves_qty) {
             const auto priority = getNextPriority(price);
             const auto order = order_pool_.allocate(
                 ticker_id,
@@ -165,13 +183,9 @@ namespace Exchange {
         }
     }
     auto MEOrderBook::cancel(const ClientId client_id, const OrderId order_id, const TickerId ticker_id) noexcept -> void {
-        const auto is_cancelable = client_id < cid_oid_to_order_.size();
-        MEOrder *exchange_order = nullptr;
+        const auto co_itr = cid_oid_to_order_.find({client_id, order_id});
+        const auto exchange_order = co_itr ? *co_itr : nullptr;
 
-        if (is_cancelable) {
-            const auto &co_itr = cid_oid_to_order_.at(client_id);
-            exchange_order = co_itr.at(order_id);
-        }
         if (UNLIKELY(exchange_order == nullptr)) {
             client_response_ = {
                 ClientResponseType::CANCEL_REJECTED,
@@ -212,6 +226,119 @@ namespace Exchange {
         matching_engine_ -> sendClientResponse(&client_response_);
     }
 
+    /**
+     * Amends a resting order. A quantity reduction at the same price is applied in place and keeps the order's
+     * priority. A price change or a quantity increase moves the order to the back of the queue at its new price,
+     * matching it first if the new price crosses. The market order id is kept in both cases, and the amend is
+     * published as one MODIFIED response and one MODIFY market update (plus the fills, if it crossed).
+     */
+    auto MEOrderBook::modify(const ClientId client_id, const OrderId order_id, const TickerId ticker_id, const Price price, const Qty qty) noexcept -> void {
+        const auto co_itr = cid_oid_to_order_.find({client_id, order_id});
+        const auto exchange_order = co_itr ? *co_itr : nullptr;
+
+        if (UNLIKELY(exchange_order == nullptr || price == Price_INVALID || !qty || qty == Qty_INVALID ||
+                     (price != exchange_order -> price_ && !price_ladder_.makeRoomFor(price)))) {
+            client_response_ = {
+                ClientResponseType::MODIFY_REJECTED,
+                client_id,
+                ticker_id,
+                order_id,
+                exchange_order ? exchange_order -> market_order_id_ : OrderId_INVALID,
+                exchange_order ? exchange_order -> side_ : Side::INVALID,
+                price,
+                Qty_INVALID,
+                exchange_order ? exchange_order -> qty_ : Qty_INVALID
+            };
+            matching_engine_ -> sendClientResponse(&client_response_);
+            return;
+        }
+
+        client_response_ = {
+            ClientResponseType::MODIFIED,
+            client_id,
+            ticker_id,
+            order_id,
+            exchange_order -> market_order_id_,
+            exchange_order -> side_,
+            price,
+            0,
+            qty
+        };
+        matching_engine_ -> sendClientResponse(&client_response_);
+
+        if (price == exchange_order -> price_ && qty <= exchange_order -> qty_) {
+            exchange_order -> qty_ = qty;
+        }
+        else {
+            unlinkOrder(exchange_order);
+            const auto leaves_qty = checkForMatch(client_id, order_id, ticker_id, exchange_order -> side_, price, qty,
+                exchange_order -> market_order_id_);
+
+            if (!leaves_qty) {
+                market_update_ = {
+                    MEMarketUpdateType::CANCEL,
+                    exchange_order -> market_order_id_,
+                    ticker_id,
+                    exchange_order -> side_,
+                    exchange_order -> price_,
+                    0,
+                    exchange_order -> priority_
+                };
+                matching_engine_ -> sendMarketUpdate(&market_update_);
+
+                releaseOrder(exchange_order);
+                return;
+            }
+            exchange_order -> price_ = price;
+            exchange_order -> qty_ = leaves_qty;
+            exchange_order -> priority_ = getNextPriority(price);
+            linkOrder(exchange_order);
+        }
+
+        market_update_ = {
+            MEMarketUpdateType::MODIFY,
+            exchange_order -> market_order_id_,
+            ticker_id,
+            exchange_order -> side_,
+            exchange_order -> price_,
+            exchange_order -> qty_,
+            exchange_order -> priority_
+        };
+        matching_engine_ -> sendMarketUpdate(&market_update_);
+    }
+
+    /** Cancels every live order of client_id in this book, walking only that client's own order list. */
+    auto MEOrderBook::massCancel(const ClientId client_id, const TickerId ticker_id) noexcept -> void {
+        if (UNLIKELY(client_id >= client_orders_.size()))
+            return;
+
+        while (const auto exchange_order = client_orders_[client_id]) {
+            client_response_ = {
+                ClientResponseType::CANCELED,
+                client_id,
+                ticker_id,
+                exchange_order -> client_order_id_,
+                exchange_order -> market_order_id_,
+                exchange_order -> side_,
+                exchange_order -> price_,
+                Qty_INVALID,
+                exchange_order -> qty_
+            };
+            market_update_ = {
+                MEMarketUpdateType::CANCEL,
+                exchange_order -> market_order_id_,
+                ticker_id,
+                exchange_order -> side_,
+                exchange_order -> price_,
+                0,
+                exchange_order -> priority_
+            };
+            removeOrder(exchange_order);
+            matching_engine_ -> sendMarketUpdate(&market_update_);
+            matching_engine_ -> sendClientResponse(&client_response_);
+        }
+    }
+
     auto MEOrderBook::toString(const bool detailed, const bool validity_check) const -> std::string {
         std::stringstream ss;
         std::string time_str;
@@ -228,10 +355,8 @@ namespace Exchange {
                     break;
             }
 
-            sprintf(buf, " <px:%3s p:%3s n:%3s> %-3s @ %-5s(%-4s)",
+            sprintf(buf, " <px:%3s> %-3s @ %-5s(%-4s)",
                 priceToString(itr -> price_).c_str(),
-                priceToString(itr -> prev_entry_ -> price_).c_str(),
-                priceToString(itr -> next_entry_ -> price_).c_str(),
                 priceToString(itr -> price_).c_str(),
                 qtyToString(qty).c_str(),
                 std::to_string(num_orders).c_str());
@@ -269,14 +394,12 @@ namespace Exchange {
         ss << "Ticker:" << tickerIdToString(ticker_id_) << std::endl;
 
         {
-            auto ask_itr = asks_at_price_;
+            auto ask_itr = price_ladder_.getBestOrdersAtPrice(Side::SELL);
             auto last_ask_price = std::numeric_limits<Price>::min();
 
             for (size_t count = 0; ask_itr; ++count) {
                 ss << "ASKS L:" << count << " => ";
-                const auto next_ask_itr = ask_itr -> next_entry_ == asks_at_price_
-                    ? nullptr
-                    : ask_itr -> next_entry_;
+                const auto next_ask_itr = price_ladder_.getNextOrdersAtPrice(ask_itr);
 
                 printer(ss, ask_itr, Side::SELL, last_ask_price, validity_check);
                 ask_itr = next_ask_itr;
@@ -286,14 +409,12 @@ namespace Exchange {
         ss << std::endl << "                          X" << std::endl << std::endl;
 
         {
-            auto bid_itr = bids_at_price_;
+            auto bid_itr = price_ladder_.getBestOrdersAtPrice(Side::BUY);
             auto last_bid_price = std::numeric_limits<Price>::max();
 
             for (size_t count = 0; bid_itr; ++count) {
                 ss << "BIDS L:" << count << " => ";
-                const auto next_bid_itr = bid_itr -> next_entry_ == bids_at_price_
-                    ? nullptr
-                    : bid_itr -> next_entry_;
+                const auto next_bid_itr = price_ladder_.getNextOrdersAtPrice(bid_itr);
 
                 printer(ss, bid_itr, Side::BUY, last_bid_price, validity_check);
                 bid_itr = next_bid_itr;
@@ -4,6 +4,7 @@
 #define TRADINGECOSYSTEM_ME_ORDER_BOOK_H
 
 #include "me_order.h"
+#include "me_price_ladder.h"
 #include "low-latency-components/types.h"
 #include "low-latency-components/logging.h"
 #include "low-latency-components/mem_pool.h"
@@ -21,6 +22,11 @@ namespace Exchange {
 
         auto add(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price price, Qty qty) noexcept -> void;
         auto cancel(ClientId client_id, OrderId order_id, TickerId ticker_id) noexcept -> void;
+        auto modify(ClientId client_id, OrderId order_id, TickerId ticker_id, Price price, Qty qty) noexcept -> void;
+        auto massCancel(ClientId client_id, TickerId ticker_id) noexcept -> void;
+
+        [[nodiscard]]
+        auto tickerId() const noexcept { return ticker_id_; }
 
         [[nodiscard]]
         auto toString(bool detailed, bool validity_check) const -> std::string;
@@ -34,11 +40,10 @@ namespace Exchange {
     private:
             TickerId ticker_id_ = TickerId_INVALID;
             MatchingEngine *matching_engine_ = nullptr;
-            ClientOrderHashMap cid_oid_to_order_ = {};
-            MemPool<MEOrdersAtPrice> orders_at_price_pool_;
-            MEOrdersAtPrice *bids_at_price_ = nullptr;
-            MEOrdersAtPrice *asks_at_price_ = nullptr;
-            OrdersAtPriceHashMap price_orders_at_price_hash_map_ = {};
+            ClientOrderHashMap cid_oid_to_order_;
+            /** Head of each client's intrusive list of live orders in this book. */
+            std::array<MEOrder *, ME_MAX_NUM_CLIENTS> client_orders_ = {};
+            MEPriceLadder price_ladder_;
             MemPool<MEOrder> order_pool_;
             MEClientResponse client_response_;
             MEMarketUpdate market_update_;
@@ -51,91 +56,12 @@ namespace Exchange {
         }
 
         [[nodiscard]]
-        static auto priceToIndex(const Price price) noexcept {
-            return price % ME_MAX_PRICE_LEVELS;
+        auto getOrdersAtPrice(const Price price) noexcept -> MEOrdersAtPrice* {
+            return price_ladder_.getOrdersAtPrice(price);
         }
 
         [[nodiscard]]
-        auto getOrdersAtPrice(const Price price) const noexcept -> MEOrdersAtPrice* {
-            return price_orders_at_price_hash_map_.at(priceToIndex(price));
-        }
-
-        auto addOrdersAtPrice(MEOrdersAtPrice *new_orders_at_price) noexcept {
-            price_orders_at_price_hash_map_.at(priceToIndex(new_orders_at_price -> price_)) = new_orders_at_price;
-
-            if (const auto best_orders_by_price = new_orders_at_price -> side_ == Side::BUY ? bids_at_price_ : asks_at_price_;
-                 UNLIKELY(!best_orders_by_price)) {
-                new_orders_at_price -> side_ == Side::BUY ? bids_at_price_ : asks_at_price_ = new_orders_at_price;
-                new_orders_at_price -> prev_entry_ = new_orders_at_price -> next_entry_ = new_orders_at_price;
-            }
-            else {
-                auto target = best_orders_by_price;
-                bool add_after =
-                    new_orders_at_price -> side_ == Side::SELL && new_orders_at_price -> price_ > target -> price_ ||
-                    new_orders_at_price -> side_ == Side::BUY  && new_orders_at_price -> price_ < target -> price_;
-                if (add_after) {
-                    target = target -> next_entry_;
-                    add_after =
-                        new_orders_at_price -> side_ == Side::SELL && new_orders_at_price -> price_ > target -> price_ ||
-                        new_orders_at_price -> side_ == Side::BUY  && new_orders_at_price -> price_ < target -> price_;
-                }
-                while (add_after && target != best_orders_by_price) {
-                    add_after =
-                        new_orders_at_price -> side_ == Side::SELL && new_orders_at_price -> price_ > target -> price_ ||
-                        new_orders_at_price -> side_ == Side::BUY  && new_orders_at_price -> price_ < target -> price_;
-                    if (add_after)
-                        target = target -> next_entry_;
-                }
-                if (add_after) {
-                    /** add new_orders_at_price after target */
-                    if (target == best_orders_by_price) {
-                        target = best_orders_by_price -> prev_entry_;
-                    }
-                    new_orders_at_price -> prev_entry_ = target;
-                    target -> next_entry_ -> prev_entry_ = new_orders_at_price;
-                    target -> next_entry_ = new_orders_at_price;
-                }
-                else {
-                    /** add new_orders_at_price before target */
-                    new_orders_at_price -> prev_entry_ = target -> prev_entry_;
-                    new_orders_at_price -> next_entry_ = target;
-                    target -> prev_entry_ -> next_entry_ = new_orders_at_price;
-                    target -> prev_entry_ = new_orders_at_price;
-                    if (
-                        new_orders_at_price -> side_ == Side::BUY  && new_orders_at_price -> price_ > best_orders_by_price -> price_ ||
-                        new_orders_at_price -> side_ == Side::SELL && new_orders_at_price -> price_ < best_orders_by_price -> price_
-                        ) {
-                            target -> next_entry_ = target -> next_entry_ == best_orders_by_price ? new_orders_at_price : target -> next_entry_;
-                            new_orders_at_price -> side_ == Side::BUY ? bids_at_price_ : asks_at_price_ = new_orders_at_price;
-                    }
-                }
-            }
-        }
-
-        auto removeOrdersAtPrice(const Side side, const Price price) noexcept {
-            const auto best_orders_by_price = side == Side::BUY ? bids_at_price_ : asks_at_price_;
-            const auto orders_at_price = getOrdersAtPrice(price);
-
-            if (UNLIKELY(orders_at_price -> next_entry_ == orders_at_price)) {
-                side == Side::BUY ? bids_at_price_ : asks_at_price_ = nullptr;
-            }
-            else {
-                orders_at_price -> prev_entry_ -> next_entry_ = orders_at_price -> next_entry_;
-                orders_at_price -> next_entry_ -> prev_entry_ = orders_at_price -> prev_entry_;
-
-                if (orders_at_price == best_orders_by_price) {
-                    side == Side::BUY ? bids_at_price_ : asks_at_price_ = orders_at_price -> next_entry_;
-                }
-                orders_at_price -> prev_entry_ = orders_at_price -> next_entry_ = nullptr;
-            }
-
-            price_orders_at_price_hash_map_.at(priceToIndex(price)) = nullptr;
-            orders_at_price_pool_.deallocate(orders_at_price);
-        }
-
-
-        [[nodiscard]]
-        auto getNextPriority(const Price price) const noexcept {
+        auto getNextPriority(const Price price) noexcept {
             const auto orders_at_price = getOrdersAtPrice(price);
             if (!orders_at_price)
                 return 1lu;
@@ -146,17 +72,11 @@ namespace Exchange {
         auto match(TickerId ticker_id, ClientId client_id, Side side, OrderId client_order_id, OrderId new_market_order_id, MEOrder* itr, Qty* leaves_qty) noexcept;
         auto checkForMatch(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price price, Qty qty, Qty new_market_order_id) noexcept;
 
-        auto addOrder(MEOrder *order) noexcept {
+        /** Caller must have checked price_ladder_.makeRoomFor(order -> price_). */
+        auto linkOrder(MEOrder *order) noexcept {
             if (const auto orders_at_price = getOrdersAtPrice(order -> price_); !orders_at_price) {
                 order -> next_order_ = order -> prev_order_ = order;
-
-                const auto new_orders_at_price = orders_at_price_pool_.allocate(
-                    order -> side_,
-                    order -> price_,
-                    order,
-                    nullptr,
-                    nullptr);
-                addOrdersAtPrice(new_orders_at_price);
+                price_ladder_.addOrdersAtPrice(order -> side_, order -> price_, order);
             }
             else {
                 const auto first_order = orders_at_price -> first_me_order_;
@@ -166,16 +86,15 @@ namespace Exchange {
                 order -> next_order_ = first_order;
                 first_order -> prev_order_ = order;
             }
-            cid_oid_to_order_.at(order -> client_id_).at(order -> client_order_id_) = order;
         }
 
-        auto removeOrder(MEOrder *order) noexcept {
-            const auto orders_at_price = getOrdersAtPrice(order -> price_);
-
+        /** Takes order out of its price level, leaving it allocated and indexed by client order id. */
+        auto unlinkOrder(MEOrder *order) noexcept {
             if (order -> prev_order_ == order) {
-                removeOrdersAtPrice(order -> side_, order -> price_);
+                price_ladder_.removeOrdersAtPrice(order -> side_, order -> price_);
             }
             else {
+                const auto orders_at_price = getOrdersAtPrice(order -> price_);
                 const auto order_before = order -> prev_order_;
                 const auto order_after  = order -> next_order_;
                 order_before -> next_order_ = order_after;
@@ -184,12 +103,40 @@ namespace Exchange {
                 if (orders_at_price -> first_me_order_ == order) {
                     orders_at_price -> first_me_order_ = order_after;
                 }
-
-                order -> prev_order_ = order -> next_order_ = nullptr;
             }
-            cid_oid_to_order_.at(order -> client_id_).at(order -> client_order_id_) = nullptr;
+            order -> prev_order_ = order -> next_order_ = nullptr;
+        }
+
+        auto addOrder(MEOrder *order) noexcept {
+            linkOrder(order);
+            cid_oid_to_order_.insert({order -> client_id_, order -> client_order_id_}, order);
+
+            auto &first_client_order = client_orders_[order -> client_id_];
+            order -> prev_client_order_ = nullptr;
+            order -> next_client_order_ = first_client_order;
+            if (first_client_order)
+                first_client_order -> prev_client_order_ = order;
+            first_client_order = order;
+        }
+
+        /** Drops an order that is no longer linked into a price level from the client indices and frees it. */
+        auto releaseOrder(MEOrder *order) noexcept {
+            cid_oid_to_order_.erase({order -> client_id_, order -> client_order_id_});
+
+            if (order -> prev_client_order_)
+                order -> prev_client_order_ -> next_client_order_ = order -> next_client_order_;
+            else
+                client_orders_[order -> client_id_] = order -> next_client_order_;
+            if (order -> next_client_order_)
+                order -> next_client_order_ -> prev_client_order_ = order -> prev_client_order_;
+
             order_pool_.deallocate(order);
         }
+
+        auto removeOrder(MEOrder *order) noexcept {
+            unlinkOrder(order);
+            releaseOrder(order);
+        }
     };
     typedef std::array<MEOrderBook *, ME_MAX_TICKERS> OrderBookHashMap;
 }
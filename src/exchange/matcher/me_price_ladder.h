@@ -0,0 +1,183 @@
+#pragma once
+
+#ifndef TRADINGECOSYSTEM_ME_PRICE_LADDER_H
+#define TRADINGECOSYSTEM_ME_PRICE_LADDER_H
+
+#include <array>
+#include "me_order.h"
+#include "low-latency-components/macros.h"
+#include "low-latency-components/bitmap_index.h"
+#include "low-latency-components/types.h"
+
+using namespace Common;
+
+namespace Exchange {
+    /**
+     * Dense, tick-indexed array of MEOrdersAtPrice covering a window of ME_MAX_PRICE_LEVELS consecutive prices.
+     * The window starts at base_price_ and is stored circularly (slot = price & mask), so re-centring the
+     * window on a moving market only updates base_price_ and never moves a level in memory.
+     * Every live level of both sides is always inside the window, which makes slot collisions impossible.
+     * Each side keeps a BitmapIndex of its occupied slots, so the next level away from (or towards) the touch
+     * is found with a handful of bit scans, however sparse the book is.
+     */
+    class MEPriceLadder final {
+    public:
+        static_assert((ME_MAX_PRICE_LEVELS & (ME_MAX_PRICE_LEVELS - 1)) == 0, "ME_MAX_PRICE_LEVELS must be a power of two.");
+
+        MEPriceLadder() = default;
+
+        [[nodiscard]]
+        auto isInWindow(const Price price) const noexcept {
+            return static_cast<uint64_t>(price) - static_cast<uint64_t>(base_price_) < ME_MAX_PRICE_LEVELS;
+        }
+
+        [[nodiscard]]
+        auto getOrdersAtPrice(const Price price) noexcept -> MEOrdersAtPrice* {
+            if (UNLIKELY(!isInWindow(price)))
+                return nullptr;
+
+            const auto orders_at_price = &levels_[priceToIndex(price)];
+            return orders_at_price -> first_me_order_ ? orders_at_price : nullptr;
+        }
+
+        [[nodiscard]]
+        auto getBestOrdersAtPrice(const Side side) noexcept -> MEOrdersAtPrice* {
+            const auto best_price = best_price_[sideToIndex(side)];
+            return best_price == Price_INVALID ? nullptr : &levels_[priceToIndex(best_price)];
+        }
+
+        [[nodiscard]]
+        auto getBestOrdersAtPrice(const Side side) const noexcept -> const MEOrdersAtPrice* {
+            const auto best_price = best_price_[sideToIndex(side)];
+            return best_price == Price_INVALID ? nullptr : &levels_[priceToIndex(best_price)];
+        }
+
+        /** Next level on the same side, moving away from the touch. nullptr once the worst level is reached. */
+        [[nodiscard]]
+        auto getNextOrdersAtPrice(const MEOrdersAtPrice *orders_at_price) const noexcept -> const MEOrdersAtPrice* {
+            const auto side = orders_at_price -> side_;
+            const auto next_price = findNextPrice(side, orders_at_price -> price_);
+            return next_price == best_price_[sideToIndex(side)] ? nullptr : &levels_[priceToIndex(next_price)];
+        }
+
+        /**
+         * Checks that a new level at price can be added without evicting a live one,
+         * re-centring the window around the occupied prices if price lies outside of it.
+         */
+        auto makeRoomFor(const Price price) noexcept -> bool {
+            if (LIKELY(isInWindow(price)))
+                return true;
+
+            const auto low  = lowestPrice();
+            const auto high = highestPrice();
+            if (low == Price_INVALID) {
+                base_price_ = price - static_cast<Price>(ME_MAX_PRICE_LEVELS / 2);
+                return true;
+            }
+
+            const auto new_low  = std::min(low, price);
+            const auto new_high = std::max(high, price);
+            const auto span = static_cast<uint64_t>(new_high) - static_cast<uint64_t>(new_low);
+            if (span >= ME_MAX_PRICE_LEVELS)
+                return false;
+
+            base_price_ = new_low - static_cast<Price>((ME_MAX_PRICE_LEVELS - 1 - span) / 2);
+            return true;
+        }
+
+        /** Caller must have checked makeRoomFor(price) and that no level exists at price yet. */
+        auto addOrdersAtPrice(const Side side, const Price price, MEOrder *first_me_order) noexcept -> MEOrdersAtPrice* {
+            const auto index = priceToIndex(price);
+            const auto orders_at_price = &levels_[index];
+            *orders_at_price = MEOrdersAtPrice(side, price, first_me_order);
+
+            const auto side_index = sideToIndex(side);
+            occupied_[side_index].set(index);
+            if (auto &best = best_price_[side_index]; best == Price_INVALID || isBetter(side, price, best))
+                best = price;
+            return orders_at_price;
+        }
+
+        auto removeOrdersAtPrice(const Side side, const Price price) noexcept {
+            const auto index = priceToIndex(price);
+            levels_[index] = MEOrdersAtPrice();
+
+            const auto side_index = sideToIndex(side);
+            occupied_[side_index].clear(index);
+            if (auto &best = best_price_[side_index]; price == best) {
+                best = occupied_[side_index].empty() ? Price_INVALID : findNextPrice(side, price);
+            }
+        }
+
+        MEPriceLadder(const MEPriceLadder & ) = delete;
+        MEPriceLadder(const MEPriceLadder &&) = delete;
+        MEPriceLadder & operator = (const MEPriceLadder & ) = delete;
+        MEPriceLadder & operator = (const MEPriceLadder &&) = delete;
+
+    private:
+        std::array<MEOrdersAtPrice, ME_MAX_PRICE_LEVELS> levels_ = {};
+        Price base_price_ = 0;
+        std::array<Price, 2> best_price_ = { Price_INVALID, Price_INVALID };
+        std::array<BitmapIndex<ME_MAX_PRICE_LEVELS>, 2> occupied_ = {};
+
+        [[nodiscard]]
+        static auto priceToIndex(const Price price) noexcept -> size_t {
+            return static_cast<size_t>(price) & (ME_MAX_PRICE_LEVELS - 1);
+        }
+
+        [[nodiscard]]
+        static auto isBetter(const Side side, const Price lhs, const Price rhs) noexcept -> bool {
+            return side == Side::BUY ? lhs > rhs : lhs < rhs;
+        }
+
+        [[nodiscard]]
+        auto worstPrice(const Side side) const noexcept -> Price {
+            const auto best = best_price_[sideToIndex(side)];
+            return best == Price_INVALID ? Price_INVALID : findPrevPrice(side, best);
+        }
+
+        [[nodiscard]]
+        auto lowestPrice() const noexcept -> Price {
+            const auto worst_bid = worstPrice(Side::BUY);
+            return worst_bid != Price_INVALID ? worst_bid : best_price_[sideToIndex(Side::SELL)];
+        }
+
+        [[nodiscard]]
+        auto highestPrice() const noexcept -> Price {
+            const auto worst_ask = worstPrice(Side::SELL);
+            return worst_ask != Price_INVALID ? worst_ask : best_price_[sideToIndex(Side::BUY)];
+        }
+
+        /**
+         * Nearest occupied price on side strictly worse than price, wrapping around the circular window:
+         * from the worst level this lands back on the best one.
+         */
+        [[nodiscard]]
+        auto findNextPrice(const Side side, const Price price) const noexcept -> Price {
+            return levels_[findOccupied(occupied_[sideToIndex(side)], priceToIndex(price), side == Side::BUY)].price_;
+        }
+
+        /**
+         * Nearest occupied price on side strictly better than price, wrapping around the circular window:
+         * from the best level this lands on the worst one.
+         */
+        [[nodiscard]]
+        auto findPrevPrice(const Side side, const Price price) const noexcept -> Price {
+            return levels_[findOccupied(occupied_[sideToIndex(side)], priceToIndex(price), side == Side::SELL)].price_;
+        }
+
+        /** Circular scan for the nearest occupied slot after (or before, if descending) index. occupied must not be empty. */
+        [[nodiscard]]
+        static auto findOccupied(const BitmapIndex<ME_MAX_PRICE_LEVELS> &occupied, const size_t index, const bool descending) noexcept -> size_t {
+            constexpr auto npos = BitmapIndex<ME_MAX_PRICE_LEVELS>::npos;
+            if (descending) {
+                const auto slot = index ? occupied.findPrev(index - 1) : npos;
+                return slot != npos ? slot : occupied.findPrev(ME_MAX_PRICE_LEVELS - 1);
+            }
+            const auto slot = occupied.findNext(index + 1);
+            return slot != npos ? slot : occupied.findNext(0);
+        }
+    };
+}
+
+#endif //TRADINGECOSYSTEM_ME_PRICE_LADDER_H
@@ -0,0 +1,68 @@
+#include "sharded_matching_engine.h"
+
+namespace Exchange {
+    ShardedMatchingEngine::ShardedMatchingEngine(const std::vector<int> &core_ids) {
+        ASSERT(!core_ids.empty() && core_ids.size() <= ME_MAX_TICKERS,
+            "ShardedMatchingEngine needs between 1 and " + std::to_string(ME_MAX_TICKERS) + " shards.");
+
+        for ( size_t i = 0; i < core_ids.size(); ++i ) {
+            client_requests_.push_back(new ClientRequestLFQueue(ME_MAX_CLIENT_UPDATES));
+            client_responses_.push_back(new MEClientResponseLFQueue(ME_MAX_CLIENT_UPDATES));
+            market_updates_.push_back(new MEMarketUpdateLFQueue(ME_MAX_MARKET_UPDATES));
+            engines_.push_back(new MatchingEngine(client_requests_[i], client_responses_[i], market_updates_[i],
+                i, core_ids.size(), core_ids[i]));
+        }
+    }
+
+    ShardedMatchingEngine::~ShardedMatchingEngine() {
+        for ( size_t i = 0; i < engines_.size(); ++i ) {
+            delete engines_[i];
+            delete client_requests_[i];
+            delete client_responses_[i];
+            delete market_updates_[i];
+        }
+        engines_.clear();
+        client_requests_.clear();
+        client_responses_.clear();
+        market_updates_.clear();
+    }
+
+    auto ShardedMatchingEngine::start() -> void {
+        for ( const auto engine : engines_ ) {
+            engine -> start();
+        }
+    }
+
+    auto ShardedMatchingEngine::replayRequest(const MEClientRequest &request,
+        const std::function<void(const MEMarketUpdate &)> &on_market_update) noexcept -> bool {
+        if (UNLIKELY(!isValidClientRequest(request)))
+            return false;
+
+        const auto replay_on = [&](const size_t shard_id) {
+            engines_[shard_id] -> processClientRequest(&request);
+            for (auto responses = client_responses_[shard_id] -> peek(); !responses.empty(); responses = client_responses_[shard_id] -> peek())
+                client_responses_[shard_id] -> consume(responses.size());
+            for (auto updates = market_updates_[shard_id] -> peek(); !updates.empty(); updates = market_updates_[shard_id] -> peek()) {
+                if (on_market_update) {
+                    for (const auto &update : updates)
+                        on_market_update(update);
+                }
+                market_updates_[shard_id] -> consume(updates.size());
+            }
+        };
+
+        if (request.type_ == ClientRequestType::MASS_CANCEL && request.ticker_id_ == TickerId_INVALID) {
+            for (size_t shard_id = 0; shard_id < engines_.size(); ++shard_id)
+                replay_on(shard_id);
+            return true;
+        }
+        replay_on(tickerIdToShard(request.ticker_id_, engines_.size()));
+        return true;
+    }
+
+    auto ShardedMatchingEngine::stop() -> void {
+        for ( const auto engine : engines_ ) {
+            engine -> stop();
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef TRADINGECOSYSTEM_SHARDED_MATCHING_ENGINE_H
+#define TRADINGECOSYSTEM_SHARDED_MATCHING_ENGINE_H
+
+#include <vector>
+#include <functional>
+#include "matching_engine.h"
+
+namespace Exchange {
+    /**
+     * Splits the tickers over one MatchingEngine per configured core, each with its own request, response and
+     * market update queues. Requests are routed with tickerIdToShard(), so every ticker is handled by exactly
+     * one engine thread and its responses / market updates stay in sequence on that engine's queues.
+     */
+    class ShardedMatchingEngine final {
+    public:
+        explicit ShardedMatchingEngine(const std::vector<int> &core_ids);
+        ~ShardedMatchingEngine();
+
+        auto start() -> void;
+        auto stop()  -> void;
+
+        /**
+         * Applies a journaled request on the calling thread, routed like the FIFOSequencer does, and drops the
+         * responses it produces. Market updates are handed to on_market_update, if set, and dropped otherwise.
+         * Only for rebuilding the books before start(). Returns false, applying nothing, for a request failing
+         * isValidClientRequest().
+         */
+        auto replayRequest(const MEClientRequest &request,
+            const std::function<void(const MEMarketUpdate &)> &on_market_update = nullptr) noexcept -> bool;
+
+        [[nodiscard]]
+        auto numShards() const noexcept { return engines_.size(); }
+
+        [[nodiscard]]
+        auto clientRequestQueues() const noexcept -> const std::vector<ClientRequestLFQueue *>& { return client_requests_; }
+
+        [[nodiscard]]
+        auto clientResponseQueues() const noexcept -> const std::vector<MEClientResponseLFQueue *>& { return client_responses_; }
+
+        [[nodiscard]]
+        auto marketUpdateQueues() const noexcept -> const std::vector<MEMarketUpdateLFQueue *>& { return market_updates_; }
+
+        [[nodiscard]]
+        auto engine(const size_t shard_id) const noexcept { return engines_.at(shard_id); }
+
+        ShardedMatchingEngine() = delete;
+        ShardedMatchingEngine(const ShardedMatchingEngine & ) = delete;
+        ShardedMatchingEngine(const ShardedMatchingEngine &&) = delete;
+        ShardedMatchingEngine &operator = (const ShardedMatchingEngine & ) = delete;
+        ShardedMatchingEngine &operator = (const ShardedMatchingEngine &&) = delete;
+
+    private:
+        std::vector<ClientRequestLFQueue *> client_requests_;
+        std::vector<MEClientResponseLFQueue *> client_responses_;
+        std::vector<MEMarketUpdateLFQueue *> market_updates_;
+        std::vector<MatchingEngine *> engines_;
+    };
+}
+
+#endif //TRADINGECOSYSTEM_SHARDED_MATCHING_ENGINE_H
@@ -16,7 +16,10 @@ namespace Exchange {
     enum class ClientRequestType : uint8_t {
         INVALID = 0,
         NEW = 1,
-        CANCEL =2
+        CANCEL =2,
+        MODIFY = 3,
+        /** Cancels all of client_id_'s orders in ticker_id_, or in every ticker if ticker_id_ is TickerId_INVALID. */
+        MASS_CANCEL = 4
     };
 
     inline std::string clientRequestTypeToString(const ClientRequestType type) {
@@ -25,6 +28,10 @@ namespace Exchange {
                 return "NEW";
             case ClientRequestType::CANCEL:
                 return "CANCEL";
+            case ClientRequestType::MODIFY:
+                return "MODIFY";
+            case ClientRequestType::MASS_CANCEL:
+                return "MASS_CANCEL";
             case ClientRequestType::INVALID:
                 return "INVALID";
         }
@@ -57,6 +64,25 @@ namespace Exchange {
         }
     };
 
+    /**
+     * Whether the matching engine can process request: a known client and request type, on a ticker in range, or
+     * a mass cancel over every ticker. Checked before a request is sequenced, journaled or replayed.
+     */
+    inline auto isValidClientRequest(const MEClientRequest &request) noexcept -> bool {
+        if (request.client_id_ >= ME_MAX_NUM_CLIENTS)
+            return false;
+        switch (request.type_) {
+            case ClientRequestType::MASS_CANCEL:
+                return request.ticker_id_ < ME_MAX_TICKERS || request.ticker_id_ == TickerId_INVALID;
+            case ClientRequestType::NEW:
+            case ClientRequestType::CANCEL:
+            case ClientRequestType::MODIFY:
+                return request.ticker_id_ < ME_MAX_TICKERS;
+            default:
+                return false;
+        }
+    }
+
     struct OMClientRequest {
         size_t seq_num_ = 0;
         MEClientRequest me_client_request_;
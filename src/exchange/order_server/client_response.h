@@ -17,7 +17,9 @@ namespace Exchange {
         ACCEPTED = 1,
         CANCELED = 2,
         FILLED = 3,
-        CANCEL_REJECTED = 4
+        CANCEL_REJECTED = 4,
+        MODIFIED = 5,
+        MODIFY_REJECTED = 6
     };
 
     inline std::string clientResponseTypeToString(const ClientResponseType type) {
@@ -30,6 +32,10 @@ namespace Exchange {
                 return "FILLED";
             case ClientResponseType::CANCEL_REJECTED:
                 return "CANCEL_REJECTED";
+            case ClientResponseType::MODIFIED:
+                return "MODIFIED";
+            case ClientResponseType::MODIFY_REJECTED:
+                return "MODIFY_REJECTED";
             case ClientResponseType::INVALID:
                 return "INVALID";
         }
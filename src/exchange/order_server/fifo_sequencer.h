@@ -3,26 +3,62 @@
 #ifndef TRADINGECOSYSTEM_FIFO_SEQUENCER_H
 #define TRADINGECOSYSTEM_FIFO_SEQUENCER_H
 
+#include <span>
+#include <vector>
 #include "low-latency-components/macros.h"
 #include "low-latency-components/logging.h"
+#include "low-latency-components/latency_probes.h"
 #include "low-latency-components/thread_utils.h"
 #include "exchange/order_server/client_request.h"
+#include "exchange/journal/request_journal.h"
 
 namespace Exchange {
     constexpr size_t ME_MAX_PENDING_REQUESTS = 1024;
 
     class FIFOSequencer {
     public:
-        FIFOSequencer(ClientRequestLFQueue *client_requests, Logger *logger) :
-        incoming_requests_(client_requests),
-        logger_(logger)
+        FIFOSequencer(ClientRequestLFQueue *client_requests, Logger *logger, RequestJournal *journal = nullptr) :
+        FIFOSequencer(std::vector<ClientRequestLFQueue *>{client_requests}, logger, journal)
         {}
 
-        auto addClientRequest(const Nanos rx_time, const MEClientRequest &request) {
+        /**
+         * One queue per matching engine shard, requests are routed to the shard owning their ticker.
+         * With a journal every request is also numbered and written to it, ahead of the engines.
+         */
+        FIFOSequencer(const std::vector<ClientRequestLFQueue *> &client_requests, Logger *logger, RequestJournal *journal = nullptr) :
+        journal_records_(journal ? journal -> records() : nullptr),
+        next_seq_num_(journal ? journal -> lastSeqNum() + 1 : 1),
+        logger_(logger)
+        {
+            ASSERT(!client_requests.empty(), "FIFOSequencer needs at least one ClientRequestLFQueue.");
+            for (const auto queue : client_requests) {
+                incoming_requests_.emplace_back(queue);
+                if constexpr (LATENCY_PROBES_ENABLED)
+                    request_probes_.push_back(LatencyProbes::instance().probesFor(queue));
+            }
+        }
+
+        /** recv_ticks is the TSC time the OrderServer picked the request up at, for the latency probes. */
+        auto addClientRequest(const Nanos rx_time, const MEClientRequest &request, const uint64_t recv_ticks = 0) {
             if (pending_size_ >= pending_client_requests_.size()) {
                 FATAL("Too many pending requests");
             }
-            pending_client_requests_.at(pending_size_++) = std::move( RecvTimeClientRequest {rx_time, request} );
+            pending_client_requests_.at(pending_size_++) = std::move( RecvTimeClientRequest {rx_time, request, recv_ticks} );
+        }
+
+        /** A run of validated requests read straight out of a socket's receive ring, all received at rx_time. */
+        auto addClientRequests(const Nanos rx_time, const std::span<const OMClientRequest> requests, const uint64_t recv_ticks = 0) {
+            if (pending_size_ + requests.size() > pending_client_requests_.size()) {
+                FATAL("Too many pending requests");
+            }
+            for (const auto &request : requests)
+                pending_client_requests_[pending_size_++] = RecvTimeClientRequest {rx_time, request.me_client_request_, recv_ticks};
+        }
+
+        /** Requests that can still be added before sequenceAndPublish() has to run. */
+        [[nodiscard]]
+        auto pendingCapacity() const noexcept -> size_t {
+            return pending_client_requests_.size() - pending_size_;
         }
 
         auto sequenceAndPublish() {
@@ -35,29 +71,61 @@ namespace Exchange {
 
             std::sort(pending_client_requests_.begin(), pending_client_requests_.begin() + pending_size_);
 
+            const auto num_shards = incoming_requests_.size();
+            const auto sequenced_ticks = LATENCY_PROBES_ENABLED ? TSCClock::ticks() : 0;
             for (size_t i = 0; i < pending_size_; ++i) {
-                const auto &[recv_time_, request_] = pending_client_requests_.at(i);
+                const auto &[recv_time_, request_, recv_ticks_] = pending_client_requests_.at(i);
+
+                /** Never journal a request the engines would reject, it would be replayed on every restart. */
+                if (UNLIKELY(!isValidClientRequest(request_))) {
+                    logger_ -> log("%:% %() % Dropping invalid Req: %. \n",
+                        __FILE__, __LINE__, __func__,
+                        getCurrentTimeStr(&time_str_),
+                        request_);
+                    continue;
+                }
 
                 logger_ -> log("%:% %() % Writing RX: %, Req: %. \n",
                     __FILE__, __LINE__, __func__,
                     getCurrentTimeStr(&time_str_),
                     recv_time_,
-                    request_.toString());
-                const auto next_write = incoming_requests_ -> getNextToWriteTo();
-                *next_write = std::move(request_);
-                incoming_requests_ -> updateWriteIndex();
+                    request_);
+                if constexpr (LATENCY_PROBES_ENABLED) {
+                    auto &probes = LatencyProbes::instance();
+                    probes.recordFromKernel(ProbeStage::KERNEL_RX_TO_RECV_CALLBACK, recv_time_, recv_ticks_);
+                    probes.recordTicks(ProbeStage::RECV_CALLBACK_TO_SEQUENCED, recv_ticks_, sequenced_ticks);
+                }
+                const RequestProbe probe{recv_time_, recv_ticks_, sequenced_ticks};
+
+                if (journal_records_.queue())
+                    *journal_records_.next() = JournalRecord{next_seq_num_++, recv_time_, request_};
+
+                if (UNLIKELY(request_.ticker_id_ == TickerId_INVALID && request_.type_ == ClientRequestType::MASS_CANCEL)) {
+                    for (size_t shard = 0; shard < num_shards; ++shard)
+                        write(shard, request_, probe);
+                    continue;
+                }
+                write(tickerIdToShard(request_.ticker_id_, num_shards), request_, probe);
             }
+            journal_records_.publish();
+            for (auto &incoming_requests : incoming_requests_)
+                incoming_requests.publish();
             pending_size_ = 0;
         }
 
     private:
-        ClientRequestLFQueue *incoming_requests_ = nullptr;
+        std::vector<LFQueueBatchWriter<MEClientRequest>> incoming_requests_;
+        /** Latency probe side table of each queue in incoming_requests_, empty when probes are compiled out. */
+        std::vector<RequestProbe *> request_probes_;
+        LFQueueBatchWriter<JournalRecord> journal_records_;
+        uint64_t next_seq_num_ = 1;
         std::string time_str_;
         Logger *logger_ = nullptr;
 
         struct RecvTimeClientRequest {
             Nanos recv_time_ = 0;
             MEClientRequest request_;
+            uint64_t recv_ticks_ = 0;
 
             auto operator < (const RecvTimeClientRequest &rhs) const {
                 return recv_time_ < rhs.recv_time_;
@@ -66,6 +134,13 @@ namespace Exchange {
 
         std::array<RecvTimeClientRequest, ME_MAX_PENDING_REQUESTS> pending_client_requests_;
         size_t pending_size_ = 0;
+
+        auto write(const size_t shard, const MEClientRequest &request, const RequestProbe &probe) noexcept -> void {
+            const auto slot = incoming_requests_[shard].next();
+            *slot = request;
+            if constexpr (LATENCY_PROBES_ENABLED)
+                request_probes_[shard][incoming_requests_[shard].queue() -> indexOf(slot)] = probe;
+        }
     };
 }
 
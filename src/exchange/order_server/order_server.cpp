@@ -6,17 +6,35 @@ namespace Exchange {
         MEClientResponseLFQueue *client_responses,
         const std::string &iface,
         const int port) :
+        OrderServer(std::vector<ClientRequestLFQueue *>{client_requests},
+            std::vector<MEClientResponseLFQueue *>{client_responses}, iface, port)
+        {}
+
+    OrderServer::OrderServer(
+        const std::vector<ClientRequestLFQueue *> &client_requests,
+        const std::vector<MEClientResponseLFQueue *> &client_responses,
+        const std::string &iface,
+        const int port,
+        RequestJournal *journal,
+        const TCPServerCfg &tcp_cfg) :
         logger_("exchange_order_server.log"),
         port_(port),
-        tcp_server_(logger_),
+        tcp_server_(logger_, tcp_cfg),
         iface_(iface),
-        fifo_sequencer_(client_requests, &logger_),
+        fifo_sequencer_(client_requests, &logger_, journal),
         outgoing_responses_(client_responses)
         {
+            ASSERT(client_requests.size() == client_responses.size(),
+                "OrderServer needs one ClientResponse queue per ClientRequest queue.");
             cid_next_outgoing_seq_num_.fill(1);
             cid_next_exp_seq_num_.fill(1);
             cid_tcp_socket_.fill(nullptr);
 
+            if constexpr (LATENCY_PROBES_ENABLED) {
+                for (const auto queue : client_responses)
+                    response_probes_.push_back(LatencyProbes::instance().probesFor(queue));
+            }
+
             tcp_server_.recv_callback_ = [this](auto socket, auto rx_time) {
                 recvCallback(socket, rx_time);
             };
@@ -24,6 +42,10 @@ namespace Exchange {
             tcp_server_.recv_finished_callback_ = [this] {
                 recvFinishedCallBack();
             };
+
+            tcp_server_.disconnect_callback_ = [this](auto socket) {
+                disconnectCallback(socket);
+            };
         }
 
     auto OrderServer::start() -> void {
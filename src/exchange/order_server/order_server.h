@@ -5,6 +5,7 @@
 
 #include <functional>
 #include "low-latency-components/tcp_server.h"
+#include "low-latency-components/latency_probes.h"
 #include "exchange/order_server/fifo_sequencer.h"
 #include "exchange/order_server/client_request.h"
 #include "exchange/order_server/client_response.h"
@@ -13,12 +14,16 @@ namespace Exchange {
     class OrderServer {
     public:
         OrderServer(ClientRequestLFQueue *client_requests, MEClientResponseLFQueue *client_responses, const std::string &iface, int port);
+        /** Sharded mode, one request / response queue pair per matching engine shard, indexed by shard id. */
+        OrderServer(const std::vector<ClientRequestLFQueue *> &client_requests,
+            const std::vector<MEClientResponseLFQueue *> &client_responses, const std::string &iface, int port,
+            RequestJournal *journal = nullptr, const TCPServerCfg &tcp_cfg = {});
         ~OrderServer();
         auto start() -> void;
         auto stop()  -> void;
 
         auto run() noexcept {
-            logger_.log("%:% %() % %.\n",
+            logger_.log("%:% %() %.\n",
                 __FILE__, __LINE__, __func__,
                 getCurrentTimeStr(&time_str_));
 
@@ -26,79 +31,164 @@ namespace Exchange {
                 tcp_server_.poll();
                 tcp_server_.sendAndRecv();
 
-                for (auto client_response = outgoing_responses_ -> getNextToRead(); outgoing_responses_ -> size() && client_response; client_response = outgoing_responses_ -> getNextToRead()) {
-                    auto &next_outgoing_seq_num_ = cid_next_outgoing_seq_num_[client_response -> client_id_];
-                    logger_.log("%:% %() % Processing cid: %, seq: % %. \n",
-                        __FILE__, __LINE__, __func__,
-                        getCurrentTimeStr(&time_str_),
-                        client_response -> client_id_,
-                        next_outgoing_seq_num_,
-                        client_response -> toString());
-
-                    ASSERT(cid_tcp_socket_[client_response -> client_id_] != nullptr, "Don't have a TCPSocket for Client_id: "
-                        + std::to_string(client_response -> client_id_));
-                    cid_tcp_socket_[client_response -> client_id_] -> send(&next_outgoing_seq_num_, sizeof(next_outgoing_seq_num_));
-                    cid_tcp_socket_[client_response -> client_id_] -> send(client_response, sizeof(MEClientResponse));
-                    outgoing_responses_ -> updateReadIndex();
-                    ++next_outgoing_seq_num_;
+                for (size_t shard = 0; shard < outgoing_responses_.size(); ++shard) {
+                    const auto outgoing_responses = outgoing_responses_[shard];
+                    const auto client_responses = outgoing_responses -> peek();
+                    const auto dequeue_ticks = LATENCY_PROBES_ENABLED && !client_responses.empty() ? TSCClock::ticks() : 0;
+                    for (const auto &client_response : client_responses) {
+                        auto &next_outgoing_seq_num_ = cid_next_outgoing_seq_num_[client_response.client_id_];
+                        logger_.log("%:% %() % Processing cid: %, seq: % %. \n",
+                            __FILE__, __LINE__, __func__,
+                            getCurrentTimeStr(&time_str_),
+                            client_response.client_id_,
+                            next_outgoing_seq_num_,
+                            client_response);
+
+                        if (UNLIKELY(cid_tcp_socket_[client_response.client_id_] == nullptr)) {
+                            /** Client disconnected, e.g. these are the cancels of its cancel-on-disconnect. */
+                            logger_.log("%:% %() % Dropping response for disconnected Client_id: %. \n",
+                                __FILE__, __LINE__, __func__,
+                                getCurrentTimeStr(&time_str_),
+                                client_response.client_id_);
+                            continue;
+                        }
+                        /** One send per response, so a slow consumer's stream is cut between responses, never inside one. */
+                        const OMClientResponse om_client_response{next_outgoing_seq_num_, client_response};
+                        if (UNLIKELY(!cid_tcp_socket_[client_response.client_id_] -> send(&om_client_response, sizeof(om_client_response))))
+                            continue;
+                        ++next_outgoing_seq_num_;
+
+                        if constexpr (LATENCY_PROBES_ENABLED) {
+                            auto probe = response_probes_[shard][outgoing_responses -> indexOf(&client_response)];
+                            probe.response_dequeue_ = dequeue_ticks;
+                            LatencyProbes::instance().recordTicks(ProbeStage::ENGINE_EXIT_TO_RESPONSE_DEQUEUE, probe.engine_exit_, dequeue_ticks);
+                            cid_tcp_socket_[client_response.client_id_] -> addProbe(probe);
+                        }
+                    }
+                    outgoing_responses -> consume(client_responses.size());
                 }
             }
         }
 
+        /**
+         * Validates the whole requests in the socket's receive ring in place and hands the sequencer each run of valid
+         * ones as a span, then consumes them. A partial request stays in the ring, contiguous once its tail arrives
+         * even across the ring's end, so nothing is ever copied back to the front. The ring can hold more requests than
+         * the sequencer, which is sequenced and published early whenever a run would overflow it.
+         */
         auto recvCallback(TCPSocket *socket, const Nanos rx_time) noexcept {
+            const auto received = socket -> received();
             logger_.log("%:% %() % Received socket: %, len: %, rx: %. \n",
                 __FILE__, __LINE__, __func__,
                 getCurrentTimeStr(&time_str_),
                 socket -> socket_fd_,
-                socket -> next_rcv_valid_index_,
+                received.size(),
                 rx_time);
-            if (socket -> next_rcv_valid_index_ >= sizeof(OMClientRequest)) {
-                size_t i = 0;
-                for ( ; i + sizeof(OMClientRequest) <= socket -> next_rcv_valid_index_; i += sizeof(OMClientRequest)) {
-                    const auto request = reinterpret_cast<const OMClientRequest*> (socket -> inbound_data_.data() + i);
-                    logger_.log("%:% %() % Received: % \n",
-                        __FILE__, __LINE__, __func__,
-                        getCurrentTimeStr(&time_str_),
-                        request -> toString());
-
-                    if (UNLIKELY(cid_tcp_socket_[request -> me_client_request_.client_id_] == nullptr)) {
-                        cid_tcp_socket_[request -> me_client_request_.client_id_] = socket;
-                    }
+            const auto recv_ticks = LATENCY_PROBES_ENABLED ? TSCClock::ticks() : 0;
+            const std::span requests(reinterpret_cast<const OMClientRequest *>(received.data()), received.size() / sizeof(OMClientRequest));
+
+            size_t run_begin = 0;
+            for (size_t i = 0; i < requests.size(); ++i) {
+                if (UNLIKELY(i - run_begin == fifo_sequencer_.pendingCapacity())) {
+                    fifo_sequencer_.addClientRequests(rx_time, requests.subspan(run_begin, i - run_begin), recv_ticks);
+                    fifo_sequencer_.sequenceAndPublish();
+                    run_begin = i;
+                }
+                if (LIKELY(validateRequest(socket, requests[i])))
+                    continue;
+                fifo_sequencer_.addClientRequests(rx_time, requests.subspan(run_begin, i - run_begin), recv_ticks);
+                run_begin = i + 1;
+            }
+            fifo_sequencer_.addClientRequests(rx_time, requests.subspan(run_begin), recv_ticks);
 
-                    if (cid_tcp_socket_[request -> me_client_request_.client_id_] != socket) {
-                        logger_.log("%:% %() % Received ClientRequest from Client_id: % on different socket: %. Expected: %. \n",
-                            __FILE__, __LINE__, __func__,
-                            getCurrentTimeStr(&time_str_),
-                            request -> me_client_request_.client_id_,
-                            socket -> socket_fd_,
-                            cid_tcp_socket_[request -> me_client_request_.client_id_] -> socket_fd_);
-                        continue;
-                    }
+            socket -> consume(requests.size_bytes());
+        }
+
+        /** Binds a new client to the socket and checks the request's client, socket, sequence number, type and ticker. */
+        auto validateRequest(TCPSocket *socket, const OMClientRequest &request) noexcept -> bool {
+            logger_.log("%:% %() % Received: % \n",
+                __FILE__, __LINE__, __func__,
+                getCurrentTimeStr(&time_str_),
+                request);
+
+            const auto client_id = request.me_client_request_.client_id_;
+            if (UNLIKELY(client_id >= ME_MAX_NUM_CLIENTS)) {
+                logger_.log("%:% %() % Received ClientRequest for invalid Client_id: % on socket: %. \n",
+                    __FILE__, __LINE__, __func__,
+                    getCurrentTimeStr(&time_str_),
+                    client_id,
+                    socket -> socket_fd_);
+                return false;
+            }
 
-                    auto &next_exp_seq_num = cid_next_exp_seq_num_[request -> me_client_request_.client_id_];
+            if (UNLIKELY(cid_tcp_socket_[client_id] == nullptr)) {
+                cid_tcp_socket_[client_id] = socket;
+            }
 
-                    if (request -> seq_num_ != next_exp_seq_num) {
-                        logger_.log("%:% %() % Incorrect sequence number. Client_id: %, SeqNum expected: %, received: %. \n",
-                            __FILE__, __LINE__, __func__,
-                            getCurrentTimeStr(&time_str_),
-                            request -> me_client_request_.client_id_,
-                            next_exp_seq_num,
-                            request -> seq_num_);
-                        continue;
-                    }
-                    ++next_exp_seq_num;
-                    fifo_sequencer_.addClientRequest(rx_time, request -> me_client_request_);
-                }
+            if (cid_tcp_socket_[client_id] != socket) {
+                logger_.log("%:% %() % Received ClientRequest from Client_id: % on different socket: %. Expected: %. \n",
+                    __FILE__, __LINE__, __func__,
+                    getCurrentTimeStr(&time_str_),
+                    client_id,
+                    socket -> socket_fd_,
+                    cid_tcp_socket_[client_id] -> socket_fd_);
+                return false;
+            }
 
-                memcpy(socket -> inbound_data_.data(), socket -> inbound_data_.data() + i, socket -> next_rcv_valid_index_ - i);
-                socket -> next_rcv_valid_index_ -= i;
+            auto &next_exp_seq_num = cid_next_exp_seq_num_[client_id];
+
+            if (request.seq_num_ != next_exp_seq_num) {
+                logger_.log("%:% %() % Incorrect sequence number. Client_id: %, SeqNum expected: %, received: %. \n",
+                    __FILE__, __LINE__, __func__,
+                    getCurrentTimeStr(&time_str_),
+                    client_id,
+                    next_exp_seq_num,
+                    request.seq_num_);
+                return false;
+            }
+            ++next_exp_seq_num;
+
+            if (UNLIKELY(!isValidClientRequest(request.me_client_request_))) {
+                logger_.log("%:% %() % Received invalid ClientRequest: % on socket: %. \n",
+                    __FILE__, __LINE__, __func__,
+                    getCurrentTimeStr(&time_str_),
+                    request.me_client_request_.toString(),
+                    socket -> socket_fd_);
+                return false;
             }
+            return true;
         }
 
         auto recvFinishedCallBack() noexcept {
             fifo_sequencer_.sequenceAndPublish();
         }
 
+        /** Cancel-on-disconnect: every client session on the hung up socket gets a mass cancel over all tickers. */
+        auto disconnectCallback(TCPSocket *socket) noexcept {
+            for (ClientId client_id = 0; client_id < cid_tcp_socket_.size(); ++client_id) {
+                if (cid_tcp_socket_[client_id] != socket)
+                    continue;
+
+                logger_.log("%:% %() % Client_id: % disconnected from socket: %, cancelling its orders. \n",
+                    __FILE__, __LINE__, __func__,
+                    getCurrentTimeStr(&time_str_),
+                    client_id,
+                    socket -> socket_fd_);
+
+                cid_tcp_socket_[client_id] = nullptr;
+                cid_next_exp_seq_num_[client_id] = 1;
+                cid_next_outgoing_seq_num_[client_id] = 1;
+
+                MEClientRequest mass_cancel;
+                mass_cancel.type_ = ClientRequestType::MASS_CANCEL;
+                mass_cancel.client_id_ = client_id;
+                if (UNLIKELY(!fifo_sequencer_.pendingCapacity()))
+                    fifo_sequencer_.sequenceAndPublish();
+                fifo_sequencer_.addClientRequest(getCurrentNanos(), mass_cancel);
+            }
+            fifo_sequencer_.sequenceAndPublish();
+        }
+
         OrderServer() = delete;
         OrderServer(const OrderServer & ) = delete;
         OrderServer(const OrderServer &&) = delete;
@@ -113,7 +203,9 @@ namespace Exchange {
         const std::string iface_;
         volatile bool run_ =  false;
         FIFOSequencer fifo_sequencer_;
-        MEClientResponseLFQueue * outgoing_responses_ = nullptr;
+        std::vector<MEClientResponseLFQueue *> outgoing_responses_;
+        /** Latency probe side table of each queue in outgoing_responses_, empty when probes are compiled out. */
+        std::vector<RequestProbe *> response_probes_;
         std::array<size_t, ME_MAX_NUM_CLIENTS> cid_next_exp_seq_num_ = {};
         std::array<TCPSocket *, ME_MAX_NUM_CLIENTS> cid_tcp_socket_  = {};
         std::array<size_t, ME_MAX_NUM_CLIENTS> cid_next_outgoing_seq_num_ = {};
@@ -0,0 +1,129 @@
+#pragma once
+
+#ifndef TRADINGECOSYSTEM_BITMAP_INDEX_H
+#define TRADINGECOSYSTEM_BITMAP_INDEX_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include "macros.h"
+
+namespace Common
+{
+    /**
+     * Three level occupancy bitset over N slots (N <= 64^3).
+     * Level 0 holds one bit per slot, every bit of level 1 / level 2 marks a non-empty word of the level below,
+     * so findNext() / findPrev() resolve the nearest set slot with at most three ctz / clz per direction.
+     */
+    template<size_t N> class BitmapIndex final
+    {
+    public:
+        static_assert(N > 0 && N <= 64 * 64 * 64, "BitmapIndex supports up to 64^3 slots.");
+
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        auto set(const size_t index) noexcept
+        {
+            l0_[index >> 6] |= bit(index & 63);
+            l1_[index >> 12] |= bit((index >> 6) & 63);
+            l2_[index >> 18] |= bit((index >> 12) & 63);
+        }
+
+        auto clear(const size_t index) noexcept
+        {
+            if ((l0_[index >> 6] &= ~bit(index & 63)))
+                return;
+            if ((l1_[index >> 12] &= ~bit((index >> 6) & 63)))
+                return;
+            l2_[index >> 18] &= ~bit((index >> 12) & 63);
+        }
+
+        [[nodiscard]]
+        auto test(const size_t index) const noexcept -> bool
+        {
+            return l0_[index >> 6] & bit(index & 63);
+        }
+
+        [[nodiscard]]
+        auto empty() const noexcept -> bool
+        {
+            for (const auto word : l2_)
+                if (word)
+                    return false;
+            return true;
+        }
+
+        /** Lowest set index >= index, npos if there is none. */
+        [[nodiscard]]
+        auto findNext(const size_t index) const noexcept -> size_t
+        {
+            if (UNLIKELY(index >= N))
+                return npos;
+
+            size_t w0 = index >> 6;
+            if (const auto word = l0_[w0] & atOrAbove(index & 63))
+                return (w0 << 6) | ctz(word);
+
+            size_t w1 = w0 >> 6;
+            if (const auto word = l1_[w1] & above(w0 & 63)) {
+                w0 = (w1 << 6) | ctz(word);
+                return (w0 << 6) | ctz(l0_[w0]);
+            }
+
+            for (size_t w2 = w1 >> 6; w2 < L2_WORDS; ++w2) {
+                if (const auto word = l2_[w2] & (w2 == (w1 >> 6) ? above(w1 & 63) : ~0ULL)) {
+                    w1 = (w2 << 6) | ctz(word);
+                    w0 = (w1 << 6) | ctz(l1_[w1]);
+                    return (w0 << 6) | ctz(l0_[w0]);
+                }
+            }
+            return npos;
+        }
+
+        /** Highest set index <= index, npos if there is none. */
+        [[nodiscard]]
+        auto findPrev(const size_t index) const noexcept -> size_t
+        {
+            if (UNLIKELY(index >= N))
+                return findPrev(N - 1);
+
+            size_t w0 = index >> 6;
+            if (const auto word = l0_[w0] & atOrBelow(index & 63))
+                return (w0 << 6) | msb(word);
+
+            size_t w1 = w0 >> 6;
+            if (const auto word = l1_[w1] & below(w0 & 63)) {
+                w0 = (w1 << 6) | msb(word);
+                return (w0 << 6) | msb(l0_[w0]);
+            }
+
+            for (size_t w2 = (w1 >> 6) + 1; w2-- > 0; ) {
+                if (const auto word = l2_[w2] & (w2 == (w1 >> 6) ? below(w1 & 63) : ~0ULL)) {
+                    w1 = (w2 << 6) | msb(word);
+                    w0 = (w1 << 6) | msb(l1_[w1]);
+                    return (w0 << 6) | msb(l0_[w0]);
+                }
+            }
+            return npos;
+        }
+
+    private:
+        static constexpr size_t L0_WORDS = (N + 63) / 64;
+        static constexpr size_t L1_WORDS = (L0_WORDS + 63) / 64;
+        static constexpr size_t L2_WORDS = (L1_WORDS + 63) / 64;
+
+        std::array<uint64_t, L0_WORDS> l0_ = {};
+        std::array<uint64_t, L1_WORDS> l1_ = {};
+        std::array<uint64_t, L2_WORDS> l2_ = {};
+
+        static constexpr auto bit(const size_t b) noexcept -> uint64_t { return 1ULL << b; }
+        static constexpr auto atOrAbove(const size_t b) noexcept -> uint64_t { return ~0ULL << b; }
+        static constexpr auto above(const size_t b) noexcept -> uint64_t { return b == 63 ? 0 : ~0ULL << (b + 1); }
+        static constexpr auto atOrBelow(const size_t b) noexcept -> uint64_t { return b == 63 ? ~0ULL : bit(b + 1) - 1; }
+        static constexpr auto below(const size_t b) noexcept -> uint64_t { return bit(b) - 1; }
+        static auto ctz(const uint64_t word) noexcept -> size_t { return static_cast<size_t>(__builtin_ctzll(word)); }
+        static auto msb(const uint64_t word) noexcept -> size_t { return 63 - static_cast<size_t>(__builtin_clzll(word)); }
+    };
+}
+
+#endif //TRADINGECOSYSTEM_BITMAP_INDEX_H
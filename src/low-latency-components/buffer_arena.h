@@ -0,0 +1,159 @@
+#pragma once
+
+#ifndef TRADINGECOSYSTEM_BUFFER_ARENA_H
+#define TRADINGECOSYSTEM_BUFFER_ARENA_H
+
+#include <span>
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <cstddef>
+#include <vector>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "macros.h"
+#include "mem_pool.h"
+
+namespace Common
+{
+    /**
+     * One mapping of capacity bytes, reserved and touched up front (explicit huge pages if available, otherwise
+     * transparent ones), handed out as fixed buffers by a bump pointer. Buffers are never given back individually,
+     * their owners are expected to live as long as the arena, so carving one never faults a page in or allocates.
+     */
+    class BufferArena final
+    {
+    public:
+        explicit BufferArena(const size_t capacity, const bool use_huge_pages = true) :
+            capacity_(capacity)
+        {
+            ASSERT(capacity_ > 0, "BufferArena needs a non zero capacity.");
+            void *storage = MAP_FAILED;
+
+            if (use_huge_pages) {
+                mapped_bytes_ = (capacity_ + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+                storage = mmap(nullptr, mapped_bytes_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+            }
+
+            if (storage == MAP_FAILED) {
+                mapped_bytes_ = capacity_;
+                storage = mmap(nullptr, mapped_bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                ASSERT(storage != MAP_FAILED, "BufferArena mmap() failed. errno:" + std::string(std::strerror(errno)));
+                if (use_huge_pages)
+                    madvise(storage, mapped_bytes_, MADV_HUGEPAGE);
+                /** Fault every page in now rather than on the first message through a buffer. */
+                memset(storage, 0, mapped_bytes_);
+            }
+            data_ = static_cast<char *>(storage);
+        }
+
+        ~BufferArena()
+        {
+            munmap(data_, mapped_bytes_);
+            data_ = nullptr;
+        }
+
+        /** Next size bytes of the arena, rounded up to a cache line so buffers never share one. */
+        auto carve(const size_t size) noexcept -> std::span<char>
+        {
+            const auto aligned_size = (size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+            ASSERT(used_ + aligned_size <= capacity_, "BufferArena out of space.");
+            const std::span<char> buffer{data_ + used_, size};
+            used_ += aligned_size;
+            return buffer;
+        }
+
+        /** Bytes an arena needs to carve num_buffers buffers of size bytes. */
+        static constexpr auto capacityFor(const size_t num_buffers, const size_t size) noexcept -> size_t
+        {
+            return num_buffers * ((size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE);
+        }
+
+        [[nodiscard]]
+        auto used() const noexcept { return used_; }
+
+        [[nodiscard]]
+        auto capacity() const noexcept { return capacity_; }
+
+        BufferArena() = delete;
+        BufferArena(const BufferArena &) = delete;
+        BufferArena(const BufferArena &&) = delete;
+        BufferArena &operator=(const BufferArena &) = delete;
+        BufferArena &operator=(const BufferArena &&) = delete;
+
+    private:
+        char *data_ = nullptr;
+        const size_t capacity_;
+        size_t mapped_bytes_ = 0;
+        size_t used_ = 0;
+    };
+
+    /**
+     * num_buffers ring buffers of buffer_size bytes (rounded up to whole pages) backed by one memfd, each mapped twice
+     * back to back: byte i and byte i + size() of a carved buffer are the same memory, so a ring's contents starting
+     * anywhere, up to a whole buffer's worth, can be read or written as one contiguous span, with no wrap to handle.
+     * Every page is faulted in up front, carving only maps the next slice of the memfd.
+     */
+    class MirroredBufferArena final
+    {
+    public:
+        MirroredBufferArena(const size_t num_buffers, const size_t buffer_size) :
+            num_buffers_(num_buffers), buffer_size_(roundToPages(buffer_size))
+        {
+            ASSERT(num_buffers_ > 0 && buffer_size_ > 0, "MirroredBufferArena needs a non zero capacity.");
+            fd_ = memfd_create("MirroredBufferArena", MFD_CLOEXEC);
+            ASSERT(fd_ >= 0, "MirroredBufferArena memfd_create() failed. errno:" + std::string(std::strerror(errno)));
+            ASSERT(!ftruncate(fd_, static_cast<off_t>(num_buffers_ * buffer_size_)),
+                "MirroredBufferArena ftruncate() failed. errno:" + std::string(std::strerror(errno)));
+            mappings_.reserve(num_buffers_);
+        }
+
+        ~MirroredBufferArena()
+        {
+            for (const auto mapping : mappings_)
+                munmap(mapping, 2 * buffer_size_);
+            close(fd_);
+        }
+
+        /** Next buffer, its size() bytes followed by their mirror. */
+        auto carve() noexcept -> std::span<char>
+        {
+            ASSERT(mappings_.size() < num_buffers_, "MirroredBufferArena out of space.");
+            const auto offset = static_cast<off_t>(mappings_.size() * buffer_size_);
+
+            /** Reserve both halves at once so the two views of the slice land next to each other. */
+            const auto base = static_cast<char *>(mmap(nullptr, 2 * buffer_size_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            ASSERT(base != MAP_FAILED, "MirroredBufferArena mmap() failed. errno:" + std::string(std::strerror(errno)));
+            for (const auto view : {base, base + buffer_size_})
+                ASSERT(mmap(view, buffer_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED | MAP_POPULATE, fd_, offset) == view,
+                    "MirroredBufferArena mirror mmap() failed. errno:" + std::string(std::strerror(errno)));
+
+            mappings_.push_back(base);
+            return {base, buffer_size_};
+        }
+
+        [[nodiscard]]
+        auto bufferSize() const noexcept { return buffer_size_; }
+
+        MirroredBufferArena() = delete;
+        MirroredBufferArena(const MirroredBufferArena &) = delete;
+        MirroredBufferArena(const MirroredBufferArena &&) = delete;
+        MirroredBufferArena &operator=(const MirroredBufferArena &) = delete;
+        MirroredBufferArena &operator=(const MirroredBufferArena &&) = delete;
+
+    private:
+        static auto roundToPages(const size_t size) noexcept -> size_t
+        {
+            const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            return (size + page_size - 1) / page_size * page_size;
+        }
+
+        int fd_ = -1;
+        const size_t num_buffers_;
+        const size_t buffer_size_;
+        std::vector<char *> mappings_;
+    };
+}
+
+#endif //TRADINGECOSYSTEM_BUFFER_ARENA_H
@@ -0,0 +1,172 @@
+#pragma once
+
+#ifndef TRADINGECOSYSTEM_HASH_MAP_H
+#define TRADINGECOSYSTEM_HASH_MAP_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include "macros.h"
+
+namespace Common
+{
+    /** Final mixing step of MurmurHash3, spreads every input bit over the whole 64-bit result. */
+    constexpr auto mixHash(uint64_t h) noexcept -> uint64_t
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /**
+     * Open addressing hash map with robin-hood insertion and backward-shift deletion.
+     * Capacity is sized up front for the expected number of live entries at a load factor of at most 1/2,
+     * which keeps probe sequences short and bounded. An insert that would push the load past 1/2 doubles the
+     * capacity and rehashes every entry, the only allocation after construction.
+     * Per-slot probe distances live in their own byte array so probing mostly touches that array.
+     */
+    template<typename K, typename V, typename Hash> class RobinHoodHashMap final
+    {
+    public:
+        explicit RobinHoodHashMap(const size_t expected_elems) :
+            mask_(capacityFor(expected_elems) - 1),
+            entries_(mask_ + 1),
+            distances_(mask_ + 1, 0)
+        {}
+
+        [[nodiscard]]
+        auto find(const K &key) const noexcept -> const V*
+        {
+            const auto index = findIndex(key);
+            return index == npos ? nullptr : &entries_[index].value_;
+        }
+
+        [[nodiscard]]
+        auto find(const K &key) noexcept -> V*
+        {
+            return const_cast<V *>(static_cast<const RobinHoodHashMap *>(this) -> find(key));
+        }
+
+        /** Inserts key, or overwrites its value if it is already present. */
+        auto insert(const K &key, const V &value) noexcept
+        {
+            if (const auto existing = find(key)) {
+                *existing = value;
+                return;
+            }
+            if (UNLIKELY(size_ >= capacity() / 2))
+                grow();
+
+            place({key, value});
+            ++size_;
+        }
+
+        auto erase(const K &key) noexcept -> bool
+        {
+            auto index = findIndex(key);
+            if (index == npos)
+                return false;
+
+            for (auto next = (index + 1) & mask_; distances_[next] > 1; next = (index + 1) & mask_) {
+                entries_[index] = entries_[next];
+                distances_[index] = distances_[next] - 1;
+                index = next;
+            }
+            distances_[index] = 0;
+            --size_;
+            return true;
+        }
+
+        auto clear() noexcept
+        {
+            std::fill(distances_.begin(), distances_.end(), 0);
+            size_ = 0;
+        }
+
+        [[nodiscard]]
+        auto size() const noexcept -> size_t { return size_; }
+
+        [[nodiscard]]
+        auto capacity() const noexcept -> size_t { return mask_ + 1; }
+
+        RobinHoodHashMap() = delete;
+        RobinHoodHashMap(const RobinHoodHashMap &) = delete;
+        RobinHoodHashMap(const RobinHoodHashMap &&) = delete;
+        RobinHoodHashMap &operator = (const RobinHoodHashMap &) = delete;
+        RobinHoodHashMap &operator = (const RobinHoodHashMap &&) = delete;
+
+    private:
+        struct Entry
+        {
+            K key_;
+            V value_;
+        };
+
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        size_t mask_;
+        std::vector<Entry> entries_;
+        /** 0 marks an empty slot, otherwise the distance from the home slot plus one. */
+        std::vector<uint8_t> distances_;
+        size_t size_ = 0;
+
+        [[nodiscard]]
+        auto findIndex(const K &key) const noexcept -> size_t
+        {
+            auto index = Hash()(key) & mask_;
+            for (uint8_t distance = 1; distance <= distances_[index]; ++distance) {
+                if (distances_[index] == distance && entries_[index].key_ == key)
+                    return index;
+                index = (index + 1) & mask_;
+            }
+            return npos;
+        }
+
+        /** Puts an entry whose key is not present yet in its robin-hood slot. */
+        auto place(Entry entry) noexcept -> void
+        {
+            auto index = Hash()(entry.key_) & mask_;
+            for (uint8_t distance = 1; ; ++distance) {
+                if (!distances_[index]) {
+                    entries_[index] = entry;
+                    distances_[index] = distance;
+                    return;
+                }
+                if (distances_[index] < distance) {
+                    std::swap(entries_[index], entry);
+                    std::swap(distances_[index], distance);
+                }
+                ASSERT(distance != UINT8_MAX, "RobinHoodHashMap probe sequence too long.");
+                index = (index + 1) & mask_;
+            }
+        }
+
+        /** Doubles the capacity and rehashes every live entry into the new slots. */
+        auto grow() -> void
+        {
+            auto old_entries = std::move(entries_);
+            auto old_distances = std::move(distances_);
+
+            mask_ = 2 * old_distances.size() - 1;
+            entries_ = std::vector<Entry>(mask_ + 1);
+            distances_ = std::vector<uint8_t>(mask_ + 1, 0);
+            for (size_t i = 0; i < old_distances.size(); ++i)
+                if (old_distances[i])
+                    place(old_entries[i]);
+        }
+
+        static auto capacityFor(const size_t expected_elems) noexcept -> size_t
+        {
+            size_t capacity = 16;
+            while (capacity < 2 * expected_elems)
+                capacity <<= 1;
+            return capacity;
+        }
+    };
+}
+
+#endif //TRADINGECOSYSTEM_HASH_MAP_H
@@ -0,0 +1,248 @@
+#pragma once
+
+#ifndef TRADINGECOSYSTEM_IO_URING_H
+#define TRADINGECOSYSTEM_IO_URING_H
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "macros.h"
+#include "buffer_arena.h"
+
+namespace Common
+{
+    /**
+     * Minimal io_uring instance driven through the raw syscalls: the SQ / CQ rings and SQE array are mapped once,
+     * getSqe() hands out zeroed SQEs to fill, submit() publishes them and enters the kernel only when there is
+     * something to submit or the kernel asks for it, and forEachCqe() drains the CQ ring with no syscall at all.
+     * Not thread safe, one thread submits and reaps.
+     */
+    class IOUring final
+    {
+    public:
+        IOUring(const unsigned entries, const unsigned cq_entries)
+        {
+            io_uring_params params{};
+            /** Completions are posted when the thread next enters the kernel, flagged by IORING_SQ_TASKRUN, instead of interrupting it. */
+            params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG;
+            params.cq_entries = cq_entries;
+            fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+            if (fd_ < 0 && errno == EINVAL)
+            {
+                params = {};
+                params.flags = IORING_SETUP_CQSIZE;
+                params.cq_entries = cq_entries;
+                fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+            }
+            ASSERT(fd_ >= 0, "io_uring_setup() failed. errno:" + std::string(std::strerror(errno)));
+            ASSERT((params.features & IORING_FEAT_SINGLE_MMAP) && (params.features & IORING_FEAT_NODROP),
+                "io_uring needs a kernel with IORING_FEAT_SINGLE_MMAP and IORING_FEAT_NODROP.");
+
+            ring_bytes_ = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+            ring_ = static_cast<char *>(mmap(nullptr, ring_bytes_, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING));
+            ASSERT(ring_ != MAP_FAILED, "io_uring ring mmap() failed. errno:" + std::string(std::strerror(errno)));
+
+            sqes_bytes_ = params.sq_entries * sizeof(io_uring_sqe);
+            sqes_ = static_cast<io_uring_sqe *>(mmap(nullptr, sqes_bytes_, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+            ASSERT(sqes_ != MAP_FAILED, "io_uring SQE mmap() failed. errno:" + std::string(std::strerror(errno)));
+
+            sq_entries_ = params.sq_entries;
+            sq_head_ = reinterpret_cast<unsigned *>(ring_ + params.sq_off.head);
+            sq_tail_ = reinterpret_cast<unsigned *>(ring_ + params.sq_off.tail);
+            sq_mask_ = *reinterpret_cast<unsigned *>(ring_ + params.sq_off.ring_mask);
+            sq_flags_ = reinterpret_cast<unsigned *>(ring_ + params.sq_off.flags);
+            cq_head_ = reinterpret_cast<unsigned *>(ring_ + params.cq_off.head);
+            cq_tail_ = reinterpret_cast<unsigned *>(ring_ + params.cq_off.tail);
+            cq_mask_ = *reinterpret_cast<unsigned *>(ring_ + params.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<io_uring_cqe *>(ring_ + params.cq_off.cqes);
+
+            /** SQE i always sits in SQ slot i, so the indirection array is filled once. */
+            const auto sq_array = reinterpret_cast<unsigned *>(ring_ + params.sq_off.array);
+            for (unsigned i = 0; i < sq_entries_; ++i)
+                sq_array[i] = i;
+            sqe_tail_ = *sq_tail_;
+        }
+
+        ~IOUring()
+        {
+            munmap(sqes_, sqes_bytes_);
+            munmap(ring_, ring_bytes_);
+            close(fd_);
+        }
+
+        /** Next SQE, zeroed, submitting the queued ones first if the SQ ring is full. */
+        auto getSqe() noexcept -> io_uring_sqe*
+        {
+            if (UNLIKELY(sqe_tail_ - std::atomic_ref(*sq_head_).load(std::memory_order_acquire) >= sq_entries_))
+                submit();
+            const auto sqe = &sqes_[sqe_tail_ & sq_mask_];
+            ++sqe_tail_;
+            memset(sqe, 0, sizeof(*sqe));
+            return sqe;
+        }
+
+        /**
+         * Publishes the SQEs filled since the last call and enters the kernel if there are any, or if completions wait
+         * on task work or overflowed the CQ ring. Returns the SQEs submitted, or -1 with errno set.
+         */
+        auto submit() noexcept -> int
+        {
+            const auto to_submit = sqe_tail_ - *sq_tail_;
+            if (to_submit)
+                std::atomic_ref(*sq_tail_).store(sqe_tail_, std::memory_order_release);
+
+            const auto sq_flags = std::atomic_ref(*sq_flags_).load(std::memory_order_relaxed);
+            const auto get_events = (sq_flags & (IORING_SQ_TASKRUN | IORING_SQ_CQ_OVERFLOW)) != 0;
+            if (!to_submit && !get_events)
+                return 0;
+
+            int n;
+            do
+            {
+                n = static_cast<int>(syscall(__NR_io_uring_enter, fd_, to_submit, 0,
+                    get_events ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+            } while (n < 0 && errno == EINTR);
+            return n;
+        }
+
+        /** Calls f with every CQE posted so far and frees their slots. Returns how many there were. */
+        template<typename F>
+        auto forEachCqe(F &&f) noexcept -> unsigned
+        {
+            auto head = *cq_head_;
+            const auto tail = std::atomic_ref(*cq_tail_).load(std::memory_order_acquire);
+            const auto count = tail - head;
+            for ( ; head != tail; ++head)
+                f(cqes_[head & cq_mask_]);
+            std::atomic_ref(*cq_head_).store(head, std::memory_order_release);
+            return count;
+        }
+
+        /** io_uring_register(), returns its result, -1 with errno set on failure. */
+        auto registerResource(const unsigned opcode, const void *arg, const unsigned nr_args) const noexcept -> int
+        {
+            return static_cast<int>(syscall(__NR_io_uring_register, fd_, opcode, arg, nr_args));
+        }
+
+        /** Sparse table of count fixed files, every slot empty until filled with an IORING_OP_FILES_UPDATE. */
+        auto registerFiles(const unsigned count) const -> bool
+        {
+            const std::vector<int> files(count, -1);
+            return !registerResource(IORING_REGISTER_FILES, files.data(), count);
+        }
+
+        IOUring() = delete;
+        IOUring(const IOUring &) = delete;
+        IOUring(const IOUring &&) = delete;
+        IOUring &operator=(const IOUring &) = delete;
+        IOUring &operator=(const IOUring &&) = delete;
+
+    private:
+        int fd_ = -1;
+
+        char *ring_ = nullptr;
+        size_t ring_bytes_ = 0;
+        io_uring_sqe *sqes_ = nullptr;
+        size_t sqes_bytes_ = 0;
+
+        unsigned sq_entries_ = 0;
+        unsigned sq_mask_ = 0;
+        unsigned *sq_head_ = nullptr;
+        unsigned *sq_tail_ = nullptr;
+        unsigned *sq_flags_ = nullptr;
+        /** Local SQ tail, ahead of *sq_tail_ by the SQEs filled and not published yet. */
+        unsigned sqe_tail_ = 0;
+
+        unsigned cq_mask_ = 0;
+        unsigned *cq_head_ = nullptr;
+        unsigned *cq_tail_ = nullptr;
+        io_uring_cqe *cqes_ = nullptr;
+    };
+
+    /**
+     * Provided buffer ring registered as buffer group group: num_buffers (a power of two) receive buffers of
+     * buffer_size bytes, carved with the ring itself from one pre-faulted BufferArena. The kernel picks a buffer
+     * per completion of a IOSQE_BUFFER_SELECT request, its id comes back in the CQE flags, and recycle() hands
+     * it back once its data has been consumed.
+     */
+    class IOUringBufferRing final
+    {
+    public:
+        IOUringBufferRing(const IOUring &uring, const uint16_t group, const unsigned num_buffers, const size_t buffer_size) :
+            arena_(BufferArena::capacityFor(1, num_buffers * sizeof(io_uring_buf)) +
+                BufferArena::capacityFor(num_buffers, buffer_size)),
+            group_(group), mask_(num_buffers - 1), buffer_size_(buffer_size)
+        {
+            ASSERT(num_buffers > 0 && num_buffers <= 32768 && !(num_buffers & mask_),
+                "IOUringBufferRing needs a power of two number of buffers, at most 32768.");
+
+            /** First in the arena, so the ring is page aligned as the kernel wants. */
+            bufs_ = reinterpret_cast<io_uring_buf *>(arena_.carve(num_buffers * sizeof(io_uring_buf)).data());
+            buffers_ = arena_.carve(num_buffers * buffer_size).data();
+
+            io_uring_buf_reg reg{};
+            reg.ring_addr = reinterpret_cast<uint64_t>(bufs_);
+            reg.ring_entries = num_buffers;
+            reg.bgid = group_;
+            ASSERT(!uring.registerResource(IORING_REGISTER_PBUF_RING, &reg, 1),
+                "IORING_REGISTER_PBUF_RING failed. errno:" + std::string(std::strerror(errno)));
+
+            for (unsigned bid = 0; bid < num_buffers; ++bid)
+                recycle(static_cast<uint16_t>(bid));
+            publish();
+        }
+
+        [[nodiscard]]
+        auto buffer(const uint16_t bid) const noexcept -> const char* { return buffers_ + bid * buffer_size_; }
+
+        /** Queues buffer bid for the kernel to fill again, visible to it from the next publish(). */
+        auto recycle(const uint16_t bid) noexcept -> void
+        {
+            auto &buf = bufs_[tail_ & mask_];
+            buf.addr = reinterpret_cast<uint64_t>(buffers_ + bid * buffer_size_);
+            buf.len = static_cast<uint32_t>(buffer_size_);
+            buf.bid = bid;
+            ++tail_;
+        }
+
+        auto publish() noexcept -> void
+        {
+            std::atomic_ref(bufs_[0].resv).store(tail_, std::memory_order_release);
+        }
+
+        [[nodiscard]]
+        auto group() const noexcept { return group_; }
+
+        IOUringBufferRing() = delete;
+        IOUringBufferRing(const IOUringBufferRing &) = delete;
+        IOUringBufferRing(const IOUringBufferRing &&) = delete;
+        IOUringBufferRing &operator=(const IOUringBufferRing &) = delete;
+        IOUringBufferRing &operator=(const IOUringBufferRing &&) = delete;
+
+    private:
+        BufferArena arena_;
+        /**
+         * The ring's entries, addressed directly: io_uring_buf_ring's flexible array is misplaced when compiled as C++.
+         * The kernel reads the ring's tail from where the first entry's resv field lies, io_uring_buf_ring::tail.
+         */
+        io_uring_buf *bufs_ = nullptr;
+        char *buffers_ = nullptr;
+        const uint16_t group_;
+        const unsigned mask_;
+        const size_t buffer_size_;
+        uint16_t tail_ = 0;
+    };
+}
+
+#endif //TRADINGECOSYSTEM_IO_URING_H
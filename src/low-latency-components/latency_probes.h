@@ -0,0 +1,328 @@
+#pragma once
+
+#ifndef TRADINGECOSYSTEM_LATENCY_PROBES_H
+#define TRADINGECOSYSTEM_LATENCY_PROBES_H
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "macros.h"
+#include "logging.h"
+#include "lock_free_queue.h"
+#include "time_utils.h"
+#include "thread_utils.h"
+
+namespace Common
+{
+#ifdef LATENCY_PROBES
+    constexpr bool LATENCY_PROBES_ENABLED = true;
+#else
+    /** Every probe site is an if constexpr on this, so a build without LATENCY_PROBES contains none of them. */
+    constexpr bool LATENCY_PROBES_ENABLED = false;
+#endif
+
+    /**
+     * Fixed size log-linear histogram of nanosecond values, 32 sub-buckets per power of two (~3% resolution).
+     * Single writer: recording is a relaxed load and store on the bucket, the sum and the max, no locked
+     * instruction, while any other thread may read it or merge() it into its own copy at the same time.
+     * The count is the sum of the buckets, so it always agrees with the percentiles.
+     */
+    class HdrHistogram final
+    {
+    public:
+        static constexpr unsigned SUB_BUCKET_BITS = 5;
+        static constexpr uint64_t SUB_BUCKETS = 1ULL << SUB_BUCKET_BITS;
+        static constexpr size_t NUM_BUCKETS = 64 * SUB_BUCKETS;
+
+        auto record(const Nanos value) noexcept
+        {
+            const auto v = static_cast<uint64_t>(std::max<Nanos>(value, 0));
+            auto &bucket = counts_[bucketIndex(v)];
+            bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            sum_.store(sum_.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+            if (UNLIKELY(v > max_.load(std::memory_order_relaxed)))
+                max_.store(v, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]]
+        auto count() const noexcept
+        {
+            uint64_t count = 0;
+            for (const auto &bucket : counts_)
+                count += bucket.load(std::memory_order_relaxed);
+            return count;
+        }
+
+        [[nodiscard]]
+        auto max() const noexcept { return max_.load(std::memory_order_relaxed); }
+
+        [[nodiscard]]
+        auto mean() const noexcept -> double
+        {
+            const auto n = count();
+            return n ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / static_cast<double>(n) : 0.0;
+        }
+
+        /** Upper bound of the bucket holding the value at quantile q (0..1), never above max(). */
+        [[nodiscard]]
+        auto percentile(const double q) const noexcept -> uint64_t
+        {
+            const auto n = count();
+            if (!n)
+                return 0;
+
+            const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * static_cast<double>(n) + 0.5));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < NUM_BUCKETS; ++i)
+            {
+                seen += counts_[i].load(std::memory_order_relaxed);
+                if (seen >= rank)
+                    return std::min(bucketUpperBound(i), max());
+            }
+            return max();
+        }
+
+        /** Adds every sample of other, which may still be recording. Only on a histogram nobody records into. */
+        auto merge(const HdrHistogram &other) noexcept
+        {
+            for (size_t i = 0; i < NUM_BUCKETS; ++i)
+                counts_[i].store(counts_[i].load(std::memory_order_relaxed) + other.counts_[i].load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+            sum_.store(sum_.load(std::memory_order_relaxed) + other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            max_.store(std::max(max(), other.max()), std::memory_order_relaxed);
+        }
+
+        /**
+         * Takes out the samples of earlier, an older copy of this histogram, leaving the ones recorded since. The max
+         * becomes the upper bound of the highest bucket left. Only on a histogram nobody records into.
+         */
+        auto subtract(const HdrHistogram &earlier) noexcept
+        {
+            uint64_t max = 0;
+            for (size_t i = 0; i < NUM_BUCKETS; ++i)
+            {
+                const auto count = counts_[i].load(std::memory_order_relaxed) - earlier.counts_[i].load(std::memory_order_relaxed);
+                counts_[i].store(count, std::memory_order_relaxed);
+                if (count)
+                    max = bucketUpperBound(i);
+            }
+            sum_.store(sum_.load(std::memory_order_relaxed) - earlier.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            max_.store(std::min(max, this -> max()), std::memory_order_relaxed);
+        }
+
+        /** Only on a histogram nobody records into. */
+        auto reset() noexcept
+        {
+            for (auto &count : counts_)
+                count.store(0, std::memory_order_relaxed);
+            sum_.store(0, std::memory_order_relaxed);
+            max_.store(0, std::memory_order_relaxed);
+        }
+
+        static constexpr auto bucketIndex(const uint64_t value) noexcept -> size_t
+        {
+            if (value < 2 * SUB_BUCKETS)
+                return value;
+            const auto shift = 63 - static_cast<unsigned>(__builtin_clzll(value)) - SUB_BUCKET_BITS;
+            return (shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+        }
+
+        static constexpr auto bucketUpperBound(const size_t index) noexcept -> uint64_t
+        {
+            if (index < 2 * SUB_BUCKETS)
+                return index;
+            const auto shift = index / SUB_BUCKETS - 1;
+            return (((index % SUB_BUCKETS) + SUB_BUCKETS + 1) << shift) - 1;
+        }
+
+    private:
+        std::array<std::atomic<uint64_t>, NUM_BUCKETS> counts_ = {};
+        std::atomic<uint64_t> sum_ = {0};
+        std::atomic<uint64_t> max_ = {0};
+    };
+
+    enum class ProbeStage : uint8_t
+    {
+        KERNEL_RX_TO_RECV_CALLBACK = 0,
+        RECV_CALLBACK_TO_SEQUENCED = 1,
+        SEQUENCED_TO_ENGINE_ENTRY = 2,
+        ENGINE_ENTRY_TO_EXIT = 3,
+        ENGINE_EXIT_TO_RESPONSE_DEQUEUE = 4,
+        RESPONSE_DEQUEUE_TO_TCP_SEND = 5,
+        KERNEL_RX_TO_TCP_SEND = 6,
+        COUNT = 7
+    };
+
+    inline auto probeStageToString(const ProbeStage stage) -> std::string
+    {
+        switch (stage)
+        {
+        case ProbeStage::KERNEL_RX_TO_RECV_CALLBACK: return "kernel_rx->recv_callback";
+        case ProbeStage::RECV_CALLBACK_TO_SEQUENCED: return "recv_callback->sequenced";
+        case ProbeStage::SEQUENCED_TO_ENGINE_ENTRY: return "sequenced->engine_entry";
+        case ProbeStage::ENGINE_ENTRY_TO_EXIT: return "engine_entry->engine_exit";
+        case ProbeStage::ENGINE_EXIT_TO_RESPONSE_DEQUEUE: return "engine_exit->response_dequeue";
+        case ProbeStage::RESPONSE_DEQUEUE_TO_TCP_SEND: return "response_dequeue->tcp_send";
+        case ProbeStage::KERNEL_RX_TO_TCP_SEND: return "kernel_rx->tcp_send";
+        case ProbeStage::COUNT: break;
+        }
+        return "UNKNOWN";
+    }
+
+    /**
+     * Stage timestamps of one request, carried next to it through the pipeline.
+     * kernel_rx_ is the kernel's wall clock receive time, the rest are TSC ticks; 0 means not stamped.
+     */
+    struct RequestProbe
+    {
+        Nanos kernel_rx_ = 0;
+        uint64_t recv_callback_ = 0;
+        uint64_t sequenced_ = 0;
+        uint64_t engine_entry_ = 0;
+        uint64_t engine_exit_ = 0;
+        uint64_t response_dequeue_ = 0;
+    };
+
+    /**
+     * Per-stage latency histograms and the side tables that carry RequestProbes across the LFQueues.
+     * A side table has one RequestProbe per queue slot: the producer stamps the entry of the slot it writes
+     * before committing it, so the consumer reads it under the queue's own acquire / release ordering.
+     * Every recording thread gets its own set of histograms, registered on its first sample, so recording never
+     * shares a cache line with another thread. The reporter merges them and reports the difference to its
+     * previous merge, nothing is ever reset under a recording thread.
+     */
+    class LatencyProbes final
+    {
+    public:
+        static auto instance() -> LatencyProbes&
+        {
+            static LatencyProbes probes;
+            return probes;
+        }
+
+        /** Side table for the slots of queue, created on first use. Only call this while setting up. */
+        template<typename T> auto probesFor(const LFQueue<T> *queue) -> RequestProbe*
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            auto &probes = side_tables_[queue];
+            if (!probes)
+                probes = std::make_unique<RequestProbe[]>(queue -> capacity());
+            return probes.get();
+        }
+
+        auto record(const ProbeStage stage, const Nanos latency) noexcept
+        {
+            static thread_local ThreadHistograms *const thread_histograms = registerThread();
+            thread_histograms -> histograms_[static_cast<size_t>(stage)].record(latency);
+        }
+
+        /** Records the tick interval from -> to, skipped when either end was not stamped. */
+        auto recordTicks(const ProbeStage stage, const uint64_t from, const uint64_t to) noexcept
+        {
+            if (LIKELY(from && to))
+                record(stage, TSCClock::instance().tickDeltaToNanos(to - from));
+        }
+
+        /** Records the interval from a kernel receive time to ticks, skipped if the kernel gave no timestamp. */
+        auto recordFromKernel(const ProbeStage stage, const Nanos kernel_rx, const uint64_t to) noexcept
+        {
+            if (LIKELY(kernel_rx && to))
+                record(stage, TSCClock::instance().ticksToNanos(to) - kernel_rx);
+        }
+
+        /** Last two stages, recorded by the TCPSocket that sent the response. */
+        auto recordSent(const RequestProbe &probe, const uint64_t send_ticks) noexcept
+        {
+            recordTicks(ProbeStage::RESPONSE_DEQUEUE_TO_TCP_SEND, probe.response_dequeue_, send_ticks);
+            recordFromKernel(ProbeStage::KERNEL_RX_TO_TCP_SEND, probe.kernel_rx_, send_ticks);
+        }
+
+        /** Logs p50 / p99 / p99.9 / max of every stage that saw traffic since the previous report. */
+        auto report(Logger &logger) noexcept
+        {
+            std::string time_str;
+            for (size_t i = 0; i < reported_.size(); ++i)
+            {
+                auto &total = scratch_[0];
+                total.reset();
+                {
+                    const std::lock_guard<std::mutex> lock(mutex_);
+                    for (const auto &thread_histograms : thread_histograms_)
+                        total.merge(thread_histograms -> histograms_[i]);
+                }
+
+                auto &histogram = scratch_[1];
+                histogram.reset();
+                histogram.merge(total);
+                histogram.subtract(reported_[i]);
+                reported_[i].reset();
+                reported_[i].merge(total);
+                if (!histogram.count())
+                    continue;
+
+                logger.log("% latency % n:% mean:% p50:% p99:% p99.9:% max:% ns\n",
+                    getCurrentTimeStr(&time_str),
+                    probeStageToString(static_cast<ProbeStage>(i)),
+                    histogram.count(),
+                    static_cast<uint64_t>(histogram.mean()),
+                    histogram.percentile(0.50),
+                    histogram.percentile(0.99),
+                    histogram.percentile(0.999),
+                    histogram.max());
+            }
+        }
+
+        /** Starts a thread reporting into file_name every interval, for as long as the process runs. */
+        auto startReporting(const std::string &file_name, const Nanos interval) -> void
+        {
+            report_logger_ = std::make_unique<Logger>(file_name, 16 * 1024);
+            report_thread_ = createAndStartThread(-1, "Common/LatencyProbes", [this, interval] { runReporting(interval); });
+            ASSERT(report_thread_ != nullptr, "Failed to start LatencyProbes reporting thread.");
+        }
+
+        LatencyProbes(const LatencyProbes &) = delete;
+        LatencyProbes(const LatencyProbes &&) = delete;
+        LatencyProbes &operator = (const LatencyProbes &) = delete;
+        LatencyProbes &operator = (const LatencyProbes &&) = delete;
+
+    private:
+        struct alignas(CACHE_LINE_SIZE) ThreadHistograms
+        {
+            std::array<HdrHistogram, static_cast<size_t>(ProbeStage::COUNT)> histograms_;
+        };
+
+        LatencyProbes() = default;
+
+        auto registerThread() -> ThreadHistograms*
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            return thread_histograms_.emplace_back(std::make_unique<ThreadHistograms>()).get();
+        }
+
+        auto runReporting(const Nanos interval) noexcept -> void
+        {
+            while (true)
+            {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(interval));
+                report(*report_logger_);
+            }
+        }
+
+        std::mutex mutex_;
+        std::vector<std::unique_ptr<ThreadHistograms>> thread_histograms_;
+        /** What each stage's histograms added up to at the previous report, only touched by the reporter. */
+        std::array<HdrHistogram, static_cast<size_t>(ProbeStage::COUNT)> reported_;
+        std::array<HdrHistogram, 2> scratch_;
+        std::unordered_map<const void *, std::unique_ptr<RequestProbe[]>> side_tables_;
+
+        std::unique_ptr<Logger> report_logger_;
+        std::thread *report_thread_ = nullptr;
+    };
+}
+
+#endif //TRADINGECOSYSTEM_LATENCY_PROBES_H
@@ -3,39 +3,115 @@
 #ifndef TRADINGECOSYSTEM_LOCK_FREE_QUEUE_H
 #define TRADINGECOSYSTEM_LOCK_FREE_QUEUE_H
 
+#include <span>
 #include <atomic>
 #include <vector>
+#include <limits>
+#include <algorithm>
 #include "macros.h"
 
 namespace Common
 {
+    /**
+     * Single producer / single consumer ring.
+     * write_index_ and read_index_ are free-running counters published with release and observed with acquire,
+     * each on its own cache line together with the owning side's cached copy of the opposite index,
+     * so a side only touches its peer's line when its cached view says the ring is full / empty.
+     * Capacity is rounded up to a power of two and slots are addressed with a mask.
+     * reserve() / commit() and peek() / consume() move whole batches with a single release per batch.
+     */
     template <typename T> class LFQueue final
     {
     public:
-        explicit LFQueue(std::size_t num_elems) : store_(num_elems, T()) /** pré allocation of vector storage */
+        explicit LFQueue(std::size_t num_elems) : store_(capacityFor(num_elems), T()) /** pré allocation of vector storage */
         {}
+
+        /** Waits for the consumer if the ring is full, so nothing is ever overwritten. */
         auto getNextToWriteTo() noexcept
         {
-            return &store_[next_write_index_];
+            const auto write_index = write_index_.load(std::memory_order_relaxed);
+            while (UNLIKELY(write_index - cached_read_index_ == store_.size()))
+            {
+                cached_read_index_ = read_index_.load(std::memory_order_acquire);
+            }
+            return &store_[write_index & mask()];
         }
         auto updateWriteIndex() noexcept
         {
-            next_write_index_ = (next_write_index_ + 1) % store_.size();
-            ++num_elements_;
+            write_index_.store(write_index_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
         }
         auto getNextToRead() const noexcept -> const T*
         {
-            return next_read_index_ == next_write_index_ ? nullptr : &store_[next_read_index_];
+            const auto read_index = read_index_.load(std::memory_order_relaxed);
+            if (read_index == cached_write_index_)
+            {
+                cached_write_index_ = write_index_.load(std::memory_order_acquire);
+                if (read_index == cached_write_index_)
+                    return nullptr;
+            }
+            return &store_[read_index & mask()];
         }
         auto updateReadIndex() noexcept
         {
-            next_read_index_ = (next_read_index_ + 1) % store_.size();
-            ASSERT(num_elements_ != 0, "Read an invalid element in: " + std::to_string(pthread_self()));
-            --num_elements_;
+            const auto read_index = read_index_.load(std::memory_order_relaxed);
+            ASSERT(read_index != cached_write_index_, "Read an invalid element in: " + std::to_string(pthread_self()));
+            read_index_.store(read_index + 1, std::memory_order_release);
+        }
+
+        /**
+         * Up to n free slots starting at the write index, contiguous in memory: shorter than n if the ring is
+         * nearly full or the slots would wrap around its end, empty if the ring is full.
+         * Nothing is visible to the consumer until commit().
+         */
+        auto reserve(const std::size_t n) noexcept -> std::span<T>
+        {
+            const auto write_index = write_index_.load(std::memory_order_relaxed);
+            auto num_free = store_.size() - (write_index - cached_read_index_);
+            if (num_free < n)
+            {
+                cached_read_index_ = read_index_.load(std::memory_order_acquire);
+                num_free = store_.size() - (write_index - cached_read_index_);
+            }
+            const auto offset = write_index & mask();
+            return {&store_[offset], std::min({n, num_free, store_.size() - offset})};
+        }
+        /** Publishes the first n slots handed out by reserve(). */
+        auto commit(const std::size_t n) noexcept
+        {
+            write_index_.store(write_index_.load(std::memory_order_relaxed) + n, std::memory_order_release);
+        }
+        /** Up to max_n readable elements starting at the read index, contiguous in memory: empty if the ring is empty. */
+        auto peek(const std::size_t max_n = std::numeric_limits<std::size_t>::max()) const noexcept -> std::span<const T>
+        {
+            const auto read_index = read_index_.load(std::memory_order_relaxed);
+            auto num_readable = cached_write_index_ - read_index;
+            if (num_readable < max_n)
+            {
+                cached_write_index_ = write_index_.load(std::memory_order_acquire);
+                num_readable = cached_write_index_ - read_index;
+            }
+            const auto offset = read_index & mask();
+            return {&store_[offset], std::min({max_n, num_readable, store_.size() - offset})};
+        }
+        /** Releases the first n elements handed out by peek() back to the producer. */
+        auto consume(const std::size_t n) noexcept
+        {
+            read_index_.store(read_index_.load(std::memory_order_relaxed) + n, std::memory_order_release);
         }
+
         auto size() const noexcept
         {
-            return num_elements_.load();
+            const auto read_index = read_index_.load(std::memory_order_acquire);
+            return write_index_.load(std::memory_order_acquire) - read_index;
+        }
+        auto capacity() const noexcept
+        {
+            return store_.size();
+        }
+        /** Slot number of an element handed out by reserve() or peek(), e.g. to key side tables of capacity() entries. */
+        auto indexOf(const T *elem) const noexcept -> std::size_t
+        {
+            return elem - store_.data();
         }
 
         LFQueue() = delete;
@@ -44,11 +120,68 @@ namespace Common
         LFQueue& operator = (const LFQueue&&) = delete;
 
     private:
-        std::vector<T> store_;
-        std::atomic<size_t> next_write_index_ = {0};
-        std::atomic<size_t> next_read_index_ = {0};
-        std::atomic<size_t> num_elements_ = {0};
+        alignas(CACHE_LINE_SIZE) std::vector<T> store_;
+
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> write_index_ = {0};
+        size_t cached_read_index_ = 0;
+
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> read_index_ = {0};
+        mutable size_t cached_write_index_ = 0;
+
+        auto mask() const noexcept -> std::size_t
+        {
+            return store_.size() - 1;
+        }
+
+        static auto capacityFor(const std::size_t num_elems) noexcept -> std::size_t
+        {
+            std::size_t capacity = 1;
+            while (capacity < num_elems)
+                capacity <<= 1;
+            return capacity;
+        }
+    };
+
+    /** Producer side helper that fills reserved slots one message at a time and publishes the whole burst with one commit(). */
+    template <typename T> class LFQueueBatchWriter final
+    {
+    public:
+        explicit LFQueueBatchWriter(LFQueue<T> *queue) : queue_(queue)
+        {}
+
+        /** Slot for the next message of the burst, publishing what is pending first if the burst cannot grow in place. */
+        auto next() noexcept -> T*
+        {
+            auto next_writes = queue_ -> reserve(pending_ + 1);
+            if (UNLIKELY(next_writes.size() <= pending_))
+            {
+                publish();
+                while ((next_writes = queue_ -> reserve(1)).empty());
+            }
+            return &next_writes[pending_++];
+        }
+        auto publish() noexcept
+        {
+            if (pending_)
+            {
+                queue_ -> commit(pending_);
+                pending_ = 0;
+            }
+        }
+        /** Slots handed out by next() since the last publish(), still invisible to the consumer. */
+        auto pending() noexcept -> std::span<T>
+        {
+            return queue_ -> reserve(pending_);
+        }
+        auto queue() const noexcept
+        {
+            return queue_;
+        }
+
+    private:
+        LFQueue<T> *queue_ = nullptr;
+        std::size_t pending_ = 0;
     };
 }
 
-#endif //TRADINGECOSYSTEM_LOCK_FREE_QUEUE_H
\ No newline at end of file
+#endif //TRADINGECOSYSTEM_LOCK_FREE_QUEUE_H
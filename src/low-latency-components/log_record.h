@@ -0,0 +1,335 @@
+#pragma once
+
+#ifndef TRADINGECOSYSTEM_LOG_RECORD_H
+#define TRADINGECOSYSTEM_LOG_RECORD_H
+
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <concepts>
+#include <string_view>
+#include <type_traits>
+#include "time_utils.h"
+
+namespace Common
+{
+    enum class LogType : int8_t
+    {
+        CHAR = 0,
+        INTEGER = 1,
+        LONG_INTEGER = 2,
+        LONG_LONG_INTEGER = 3,
+        UNSIGNED_INTEGER = 4,
+        UNSIGNED_LONG_INTEGER = 5,
+        UNSIGNED_LONG_LONG_INTEGER = 6,
+        FLOAT = 7,
+        DOUBLE = 8,
+        /** uint32_t length followed by the characters, no terminator. */
+        STRING = 9,
+        /** uint64_t type reference followed by the raw bytes of a trivially copyable object. */
+        STRUCT = 10
+    };
+
+    /**
+     * Format string of a log() call, checked at compile time against the arguments it is called with.
+     * The string itself is never copied: records carry its address, which identifies the call site's format.
+     */
+    template<typename... A> class LogFormat final
+    {
+    public:
+        template<size_t N>
+        consteval LogFormat(const char (&format)[N]) : format_(format)
+        {
+            if (countPlaceholders(format) != sizeof...(A))
+                throw "log() format placeholders do not match the number of arguments";
+        }
+
+        [[nodiscard]]
+        constexpr auto get() const noexcept { return format_; }
+
+    private:
+        const char *format_ = nullptr;
+
+        static consteval auto countPlaceholders(const char *format) -> size_t
+        {
+            size_t count = 0;
+            for ( ; *format; ++format)
+            {
+                if (*format != '%')
+                    continue;
+                if (*(format + 1) == '%')
+                    ++format;
+                else
+                    ++count;
+            }
+            return count;
+        }
+    };
+
+    /** Name of T as spelled by the compiler, identical in every binary built from the same sources. */
+    template<typename T> constexpr auto logTypeName() noexcept -> std::string_view
+    {
+        constexpr std::string_view function = __PRETTY_FUNCTION__;
+        constexpr auto begin = function.find("T = ") + 4;
+        constexpr auto end = function.find_first_of(";]", begin);
+        return function.substr(begin, end - begin);
+    }
+
+    /** Objects are logged as raw bytes when they can be copied with memcpy and rendered later with toString(). */
+    template<typename T> concept LoggableStruct =
+        std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T> && std::is_class_v<T> &&
+        requires(const T &value) { { value.toString() } -> std::convertible_to<std::string>; };
+
+    struct LogStructType
+    {
+        std::string_view name_;
+        uint32_t size_ = 0;
+        auto (*to_string_)(const std::byte *data) -> std::string = nullptr;
+    };
+
+    template<LoggableStruct T> inline constexpr LogStructType LOG_STRUCT_TYPE = {
+        logTypeName<T>(),
+        sizeof(T),
+        [](const std::byte *data) -> std::string
+        {
+            T value;
+            memcpy(&value, data, sizeof(T));
+            return value.toString();
+        }
+    };
+
+    enum class LogRecordKind : uint16_t
+    {
+        RECORD = 0,
+        /** Fills the end of the ring when a record does not fit contiguously before it wraps. */
+        PADDING = 1
+    };
+
+    /**
+     * First word of every record in a Logger ring, followed by the format address, the timestamp and the
+     * encoded arguments, rounded up to whole words. A padding record only consists of this word.
+     */
+    struct LogRecordHeader
+    {
+        uint32_t num_words_ = 0;
+        uint16_t num_args_ = 0;
+        LogRecordKind kind_ = LogRecordKind::RECORD;
+    };
+    static_assert(sizeof(LogRecordHeader) == sizeof(uint64_t));
+
+    constexpr size_t LOG_RECORD_HEADER_WORDS = 3;
+
+    /** Binary log files start with LOG_FILE_MAGIC followed by a sequence of entries, see log_decoder. */
+    constexpr char LOG_FILE_MAGIC[8] = {'T', 'E', 'B', 'I', 'N', 'L', 'O', 'G'};
+
+    enum class LogFileEntryType : uint32_t
+    {
+        /** uint32_t format id, then the format string. */
+        FORMAT = 1,
+        /** uint32_t type id, uint32_t object size, then the type name. */
+        STRUCT_TYPE = 2,
+        /** LogFileRecord, then the arguments with STRUCT type references replaced by type ids. */
+        RECORD = 3
+    };
+
+    struct LogFileEntryHeader
+    {
+        LogFileEntryType type_ = LogFileEntryType::RECORD;
+        uint32_t length_ = 0;
+    };
+
+    struct LogFileRecord
+    {
+        uint32_t format_id_ = 0;
+        uint32_t num_args_ = 0;
+        Nanos time_ = 0;
+    };
+
+    template<typename T> constexpr auto logTypeOf() noexcept -> LogType
+    {
+        if constexpr (std::is_same_v<T, char>)
+            return LogType::CHAR;
+        else if constexpr (std::is_same_v<T, float>)
+            return LogType::FLOAT;
+        else if constexpr (std::is_same_v<T, double>)
+            return LogType::DOUBLE;
+        else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+            return sizeof(T) <= sizeof(int) ? LogType::INTEGER :
+                   std::is_same_v<T, long> ? LogType::LONG_INTEGER : LogType::LONG_LONG_INTEGER;
+        else if constexpr (std::is_integral_v<T>)
+            return sizeof(T) <= sizeof(unsigned) ? (std::is_same_v<T, bool> ? LogType::INTEGER : LogType::UNSIGNED_INTEGER) :
+                   std::is_same_v<T, unsigned long> ? LogType::UNSIGNED_LONG_INTEGER : LogType::UNSIGNED_LONG_LONG_INTEGER;
+        else if constexpr (LoggableStruct<T>)
+            return LogType::STRUCT;
+        else
+            return LogType::STRING;
+    }
+
+    constexpr auto logPayloadSize(const LogType type) noexcept -> size_t
+    {
+        switch (type)
+        {
+        case LogType::CHAR: return sizeof(char);
+        case LogType::INTEGER: return sizeof(int);
+        case LogType::LONG_INTEGER: return sizeof(long);
+        case LogType::LONG_LONG_INTEGER: return sizeof(long long);
+        case LogType::UNSIGNED_INTEGER: return sizeof(unsigned);
+        case LogType::UNSIGNED_LONG_INTEGER: return sizeof(unsigned long);
+        case LogType::UNSIGNED_LONG_LONG_INTEGER: return sizeof(unsigned long long);
+        case LogType::FLOAT: return sizeof(float);
+        case LogType::DOUBLE: return sizeof(double);
+        case LogType::STRING: return sizeof(uint32_t);
+        case LogType::STRUCT: return sizeof(uint64_t);
+        }
+        return 0;
+    }
+
+    template<typename T> auto logStringView(const T &value) noexcept -> std::string_view
+    {
+        if constexpr (std::is_pointer_v<T>)
+            return value ? std::string_view(value) : std::string_view("(null)");
+        else
+            return std::string_view(value);
+    }
+
+    /** Encoded size of one argument: its LogType byte followed by the payload. */
+    template<typename T> auto logArgSize(const T &value) noexcept -> size_t
+    {
+        constexpr auto type = logTypeOf<T>();
+        if constexpr (type == LogType::STRING)
+            return 1 + sizeof(uint32_t) + logStringView(value).size();
+        else if constexpr (type == LogType::STRUCT)
+            return 1 + sizeof(uint64_t) + sizeof(T);
+        else
+            return 1 + logPayloadSize(type);
+    }
+
+    template<typename T> auto encodeLogArg(std::byte *&out, const T &value) noexcept
+    {
+        constexpr auto type = logTypeOf<T>();
+        *out++ = static_cast<std::byte>(type);
+
+        if constexpr (type == LogType::STRING)
+        {
+            const auto str = logStringView(value);
+            const auto length = static_cast<uint32_t>(str.size());
+            memcpy(out, &length, sizeof(length));
+            memcpy(out + sizeof(length), str.data(), length);
+            out += sizeof(length) + length;
+        }
+        else if constexpr (type == LogType::STRUCT)
+        {
+            const auto struct_type = reinterpret_cast<uint64_t>(&LOG_STRUCT_TYPE<T>);
+            memcpy(out, &struct_type, sizeof(struct_type));
+            memcpy(out + sizeof(struct_type), &value, sizeof(T));
+            out += sizeof(struct_type) + sizeof(T);
+        }
+        else
+        {
+            /** Widened / narrowed to exactly the type the LogType names, e.g. bool and short become int. */
+            using Stored = std::conditional_t<type == LogType::INTEGER, int,
+                           std::conditional_t<type == LogType::UNSIGNED_INTEGER, unsigned, T>>;
+            const Stored stored = value;
+            memcpy(out, &stored, sizeof(stored));
+            out += sizeof(stored);
+        }
+    }
+
+    /**
+     * Calls fn(type, payload, payload_size) for each of the num_args arguments starting at args and returns the
+     * end of the last one. struct_size(type_reference) gives the object size behind a STRUCT argument.
+     */
+    template<typename StructSize, typename Fn>
+    auto forEachLogArg(const std::byte *args, const size_t num_args, StructSize &&struct_size, Fn &&fn) -> const std::byte*
+    {
+        for (size_t i = 0; i < num_args; ++i)
+        {
+            const auto type = static_cast<LogType>(*args++);
+            auto size = logPayloadSize(type);
+            if (type == LogType::STRING)
+            {
+                uint32_t length = 0;
+                memcpy(&length, args, sizeof(length));
+                size += length;
+            }
+            else if (type == LogType::STRUCT)
+            {
+                uint64_t type_reference = 0;
+                memcpy(&type_reference, args, sizeof(type_reference));
+                size += struct_size(type_reference);
+            }
+            fn(type, args, size);
+            args += size;
+        }
+        return args;
+    }
+
+    template<typename T> auto readLogValue(const std::byte *payload) noexcept -> T
+    {
+        T value;
+        memcpy(&value, payload, sizeof(T));
+        return value;
+    }
+
+    /** Appends the text of one argument, struct_to_string(type_reference, object) renders STRUCT arguments. */
+    template<typename StructToString>
+    auto renderLogArg(std::string &out, const LogType type, const std::byte *payload, StructToString &&struct_to_string)
+    {
+        char buf[64];
+        switch (type)
+        {
+        case LogType::CHAR: out += readLogValue<char>(payload); return;
+        case LogType::INTEGER: out.append(buf, snprintf(buf, sizeof(buf), "%d", readLogValue<int>(payload))); return;
+        case LogType::LONG_INTEGER: out.append(buf, snprintf(buf, sizeof(buf), "%ld", readLogValue<long>(payload))); return;
+        case LogType::LONG_LONG_INTEGER: out.append(buf, snprintf(buf, sizeof(buf), "%lld", readLogValue<long long>(payload))); return;
+        case LogType::UNSIGNED_INTEGER: out.append(buf, snprintf(buf, sizeof(buf), "%u", readLogValue<unsigned>(payload))); return;
+        case LogType::UNSIGNED_LONG_INTEGER: out.append(buf, snprintf(buf, sizeof(buf), "%lu", readLogValue<unsigned long>(payload))); return;
+        case LogType::UNSIGNED_LONG_LONG_INTEGER: out.append(buf, snprintf(buf, sizeof(buf), "%llu", readLogValue<unsigned long long>(payload))); return;
+        case LogType::FLOAT: out.append(buf, snprintf(buf, sizeof(buf), "%g", readLogValue<float>(payload))); return;
+        case LogType::DOUBLE: out.append(buf, snprintf(buf, sizeof(buf), "%g", readLogValue<double>(payload))); return;
+        case LogType::STRING:
+            out.append(reinterpret_cast<const char *>(payload) + sizeof(uint32_t), readLogValue<uint32_t>(payload));
+            return;
+        case LogType::STRUCT:
+            out += struct_to_string(readLogValue<uint64_t>(payload), payload + sizeof(uint64_t));
+            return;
+        }
+    }
+
+    /** Appends the text of a record, substituting its arguments for the placeholders of format in order. */
+    template<typename StructSize, typename StructToString>
+    auto renderLogRecord(std::string &out, const char *format, const std::byte *args, const size_t num_args,
+                         StructSize &&struct_size, StructToString &&struct_to_string)
+    {
+        forEachLogArg(args, num_args, struct_size, [&](const LogType type, const std::byte *payload, size_t)
+        {
+            for ( ; *format; ++format)
+            {
+                if (*format != '%')
+                {
+                    out += *format;
+                    continue;
+                }
+                if (*(format + 1) == '%')
+                {
+                    out += *++format;
+                    continue;
+                }
+                ++format;
+                break;
+            }
+            renderLogArg(out, type, payload, struct_to_string);
+        });
+
+        for ( ; *format; ++format)
+        {
+            if (*format == '%' && *(format + 1) == '%')
+                ++format;
+            out += *format;
+        }
+    }
+}
+
+#endif //TRADINGECOSYSTEM_LOG_RECORD_H
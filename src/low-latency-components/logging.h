@@ -3,81 +3,125 @@
 #ifndef TRADINGECOSYSTEM_LOGGING_H
 #define TRADINGECOSYSTEM_LOGGING_H
 
+#include <bit>
+#include <mutex>
 #include <string>
-#include <fstream>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <unordered_map>
 #include "macros.h"
+#include "log_record.h"
 #include "time_utils.h"
 #include "thread_utils.h"
 #include "lock_free_queue.h"
 
 namespace Common
 {
-    constexpr size_t LOG_QUEUE_SIZE = 8 * 1024 * 1024;
-    enum class LogType : int8_t
+    /** Default ring size in 8 byte words, a record takes three words plus its encoded arguments. */
+    constexpr size_t LOG_QUEUE_SIZE = 256 * 1024;
+    /** A Logger's output is written to its file in chunks of at least this many bytes while its ring is busy. */
+    constexpr size_t LOG_WRITE_SIZE = 256 * 1024;
+
+    enum class LogMode : uint8_t
     {
-        CHAR = 0,
-        INTEGER = 1,
-        LONG_INTEGER = 2,
-        LONG_LONG_INTEGER = 3,
-        UNSIGNED_INTEGER = 4,
-        UNSIGNED_LONG_INTEGER = 5,
-        UNSIGNED_LONG_LONG_INTEGER = 6,
-        FLOAT = 7,
-        DOUBLE = 8
+        /** The flusher renders every record to text. */
+        TEXT = 0,
+        /** Records are written as they are and rendered offline by log_decoder. */
+        BINARY = 1
     };
 
-    struct LogElement {
-        LogType type_ = LogType::CHAR;
-        union {
-            char c;
-            int i;
-            long l;
-            long long ll;
-            unsigned u;
-            unsigned long ul;
-            unsigned long long ull;
-            float f;
-            double d;
-        } u_ = {.c = 0};
-    };
+#ifdef BINARY_LOGGING
+    constexpr LogMode DEFAULT_LOG_MODE = LogMode::BINARY;
+#else
+    constexpr LogMode DEFAULT_LOG_MODE = LogMode::TEXT;
+#endif
 
-    class Logger final
+    class Logger;
+
+    /**
+     * Flusher thread shared by many Loggers: it drains each of their rings in turn into the Logger's own output
+     * buffer and writes that buffer out in large chunks. When a pass finds every ring empty it writes out whatever
+     * is buffered and backs off, sleeping longer the longer the rings stay empty, so a busy process gets its logs
+     * drained continuously while an idle one costs next to nothing. Every pass also gives the TSCClock its chance
+     * to re-measure, so that never happens on a thread reading the clock.
+     */
+    class LogBackend final
     {
     public:
-        auto flushQueue() noexcept
+        explicit LogBackend(const int core_id = -1, const std::string &name = "Common/LogBackend")
         {
-            while (running_)
-            {
-                for ( auto next  = queue_.getNextToRead();
-                    queue_.size() && next; next = queue_.getNextToRead())
-                {
-                    switch (next -> type_)
-                    {
-                    case LogType::CHAR: file_ << next -> u_.c; break;
-                    case LogType::INTEGER: file_ << next -> u_.i; break;
-                    case LogType::LONG_INTEGER: file_ << next -> u_.l; break;
-                    case LogType::LONG_LONG_INTEGER: file_ << next -> u_.ll; break;
-                    case LogType::UNSIGNED_INTEGER: file_ << next -> u_.u; break;
-                    case LogType::UNSIGNED_LONG_INTEGER: file_ << next -> u_.ul; break;
-                    case LogType::UNSIGNED_LONG_LONG_INTEGER: file_ << next -> u_.ull; break;
-                    case LogType::FLOAT: file_ << next -> u_.f; break;
-                    case LogType::DOUBLE: file_ << next -> u_.d; break;
-                    default:
-                        __builtin_unreachable();
-                    }
-                    queue_.updateReadIndex();
-                }
-                file_.flush();
-                using namespace std::chrono_literals;
-                std::this_thread::sleep_for(15ms);
-            }
+            backend_thread_ = createAndStartThread(core_id, name, [this] { run(); });
+            ASSERT(backend_thread_ != nullptr, "Failed to start LogBackend Thread.");
+        }
+
+        ~LogBackend()
+        {
+            running_ = false;
+            backend_thread_ -> join();
+            delete backend_thread_;
+            backend_thread_ = nullptr;
+        }
+
+        /** Backend used by every Logger that is not given one explicitly. */
+        static auto instance() -> LogBackend&
+        {
+            static LogBackend backend;
+            return backend;
+        }
+
+        auto add(Logger *logger) -> void
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            loggers_.push_back(logger);
         }
-        explicit Logger(const std::string &file_name) : file_name_(file_name), queue_(LOG_QUEUE_SIZE)
+
+        /** Once this returns the backend will not touch logger again. */
+        auto remove(Logger *logger) -> void
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            loggers_.erase(std::remove(loggers_.begin(), loggers_.end(), logger), loggers_.end());
+        }
+
+        LogBackend(const LogBackend &) = delete;
+        LogBackend(const LogBackend &&) = delete;
+        LogBackend &operator = (const LogBackend &) = delete;
+        LogBackend &operator = (const LogBackend &&) = delete;
+
+    private:
+        static constexpr Nanos MIN_IDLE_SLEEP = 50 * NANOS_TO_MICROS;
+        static constexpr Nanos MAX_IDLE_SLEEP = 10 * NANOS_TO_MILLIS;
+
+        std::mutex mutex_;
+        std::vector<Logger *> loggers_;
+        std::atomic<bool> running_ = { true };
+        std::thread *backend_thread_ = nullptr;
+
+        inline auto run() noexcept -> void;
+    };
+
+    /**
+     * log() encodes the format address, a timestamp and the raw argument bytes into one record and publishes it
+     * with a single write to the ring, nothing is formatted on the calling thread. Objects with a toString()
+     * that can be memcpy'd are copied as they are and only turned into text when the LogBackend drains the ring.
+     * The ring is sized per Logger, from a few hundred KiB for chatty components down to a few KiB for quiet ones.
+     */
+    class Logger final
+    {
+    public:
+        explicit Logger(const std::string &file_name, const size_t queue_size = LOG_QUEUE_SIZE,
+                        const LogMode mode = DEFAULT_LOG_MODE, LogBackend &backend = LogBackend::instance()) :
+            file_name_(file_name), mode_(mode), queue_(queue_size), backend_(backend)
         {
-            file_.open(file_name);
-            ASSERT(file_.is_open(), "Could not open log file: " + file_name);
-            logger_thread_ = createAndStartThread(-1, "Common/Logger" + file_name_, [this] { flushQueue(); });
-            ASSERT(logger_thread_ != nullptr, "Failed to start Logger Thread.");
+            file_fd_ = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            ASSERT(file_fd_ >= 0, "Could not open log file: " + file_name + " error:" + std::string(std::strerror(errno)));
+            out_buffer_.reserve(2 * LOG_WRITE_SIZE);
+            if (mode_ == LogMode::BINARY)
+                out_buffer_.append(LOG_FILE_MAGIC, sizeof(LOG_FILE_MAGIC));
+            backend_.add(this);
         }
 
         ~Logger()
@@ -87,125 +131,232 @@ namespace Common
             while (queue_.size())
             {
                 using namespace std::chrono_literals;
-                std::this_thread::sleep_for(1s);
+                std::this_thread::sleep_for(1ms);
             }
-            running_ =  false;
-            logger_thread_ -> join();
+            backend_.remove(this);
 
-            file_.close();
+            writeOut();
+            close(file_fd_);
             std::cerr << getCurrentTimeStr(&time_str) << " Logger for " << file_name_ << " exiting." << std::endl;
         }
 
-        auto pushValue( const LogElement &log_element) noexcept
+        template<typename... A>
+        auto log(const LogFormat<std::type_identity_t<A>...> format, const A &... args) noexcept
         {
-            *queue_.getNextToWriteTo() = log_element;
-            queue_.updateWriteIndex();
-        }
+            const auto num_bytes = (size_t{0} + ... + logArgSize(args));
+            const auto num_words = LOG_RECORD_HEADER_WORDS + (num_bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+            const auto record = reserveRecord(num_words);
 
-        auto pushValue(const char value) noexcept
-        {
-            pushValue(LogElement{LogType::CHAR, {.c = value}});
-        }
-        auto pushValue(const int value) noexcept
-        {
-            pushValue(LogElement{LogType::INTEGER, {.i = value}});
+            const LogRecordHeader header{static_cast<uint32_t>(num_words), static_cast<uint16_t>(sizeof...(A)), LogRecordKind::RECORD};
+            const auto format_str = format.get();
+            const Nanos time = getCurrentNanos();
+            memcpy(record, &header, sizeof(header));
+            memcpy(record + 1, &format_str, sizeof(format_str));
+            memcpy(record + 2, &time, sizeof(time));
+
+            auto out = reinterpret_cast<std::byte *>(record + LOG_RECORD_HEADER_WORDS);
+            (encodeLogArg(out, args), ...);
+            queue_.commit(num_words);
         }
-        auto pushValue(const long value) noexcept
+
+        Logger() = delete;
+        Logger(const Logger &) = delete;
+        Logger &operator = (const Logger & ) = delete;
+        Logger &operator = (const Logger &&) = delete;
+
+    private:
+        friend class LogBackend;
+
+        const std::string file_name_;
+        const LogMode mode_;
+        int file_fd_ = -1;
+        LFQueue<uint64_t> queue_;
+        LogBackend &backend_;
+
+        /** Rendered / encoded records waiting to be written, only touched by the backend thread. */
+        std::string out_buffer_;
+
+        /** Ids handed out to formats / struct types the first time the flusher sees them in BINARY mode. */
+        std::unordered_map<const char *, uint32_t> format_ids_;
+        std::unordered_map<uint64_t, uint32_t> struct_type_ids_;
+
+        /** Moves every published record into out_buffer_, writing it out each time it grows past LOG_WRITE_SIZE. */
+        auto drain() noexcept -> size_t
         {
-            pushValue(LogElement{LogType::LONG_INTEGER, {.l = value}});
+            size_t num_records = 0;
+            for (auto words = queue_.peek(); !words.empty(); words = queue_.peek())
+            {
+                size_t consumed = 0;
+                while (consumed < words.size())
+                {
+                    const auto record = words.data() + consumed;
+                    const auto header = std::bit_cast<LogRecordHeader>(*record);
+                    if (header.kind_ == LogRecordKind::RECORD)
+                    {
+                        if (mode_ == LogMode::BINARY)
+                            encodeRecord(out_buffer_, header, record);
+                        else
+                            renderRecord(out_buffer_, header, record);
+                        ++num_records;
+                    }
+                    consumed += header.num_words_;
+                }
+                queue_.consume(consumed);
+
+                if (out_buffer_.size() >= LOG_WRITE_SIZE)
+                    writeOut();
+            }
+            return num_records;
         }
-        auto pushValue(const long long value) noexcept
+
+        auto writeOut() noexcept -> void
         {
-            pushValue(LogElement{LogType::LONG_LONG_INTEGER, {.ll = value}});
+            for (size_t written = 0; written < out_buffer_.size(); )
+            {
+                const auto n = write(file_fd_, out_buffer_.data() + written, out_buffer_.size() - written);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                {
+                    std::cerr << "Failed to write log file: " << file_name_ << " error:" << std::strerror(errno) << std::endl;
+                    break;
+                }
+                written += static_cast<size_t>(n);
+            }
+            out_buffer_.clear();
         }
-        auto pushValue(const unsigned value) noexcept
+
+        /** Contiguous space for a record, padding out the end of the ring first if the record would wrap. */
+        auto reserveRecord(const size_t num_words) noexcept -> uint64_t*
         {
-            pushValue(LogElement{LogType::UNSIGNED_INTEGER, {.u = value}});
+            if (UNLIKELY(num_words > queue_.capacity()))
+                FATAL("Log record larger than the Logger ring.");
+            while (true)
+            {
+                const auto words = queue_.reserve(num_words);
+                if (LIKELY(words.size() == num_words))
+                    return words.data();
+                if (!words.empty())
+                {
+                    const LogRecordHeader padding{static_cast<uint32_t>(words.size()), 0, LogRecordKind::PADDING};
+                    memcpy(words.data(), &padding, sizeof(padding));
+                    queue_.commit(words.size());
+                }
+            }
         }
-        auto pushValue(const unsigned long value) noexcept
+
+        static auto structType(const uint64_t type_reference) noexcept -> const LogStructType*
         {
-            pushValue(LogElement{LogType::UNSIGNED_LONG_INTEGER, {.ul = value}});
+            return reinterpret_cast<const LogStructType *>(type_reference);
         }
-        auto pushValue(const unsigned long long value) noexcept
+
+        static auto recordArgs(const uint64_t *record) noexcept
         {
-            pushValue(LogElement{LogType::UNSIGNED_LONG_LONG_INTEGER, {.ull = value}});
+            return reinterpret_cast<const std::byte *>(record + LOG_RECORD_HEADER_WORDS);
         }
-        auto pushValue(const float value) noexcept
+
+        static auto recordFormat(const uint64_t *record) noexcept
         {
-            pushValue(LogElement{LogType::FLOAT, {.f = value}});
+            const char *format = nullptr;
+            memcpy(&format, record + 1, sizeof(format));
+            return format;
         }
-        auto pushValue(const double value) noexcept
+
+        static auto renderRecord(std::string &out, const LogRecordHeader &header, const uint64_t *record) -> void
         {
-            pushValue(LogElement{LogType::DOUBLE, {.d = value}});
+            renderLogRecord(out, recordFormat(record), recordArgs(record), header.num_args_,
+                [](const uint64_t type_reference) { return structType(type_reference) -> size_; },
+                [](const uint64_t type_reference, const std::byte *data) { return structType(type_reference) -> to_string_(data); });
         }
 
-        auto pushValue(const char *value)
+        static auto appendEntry(std::string &out, const LogFileEntryType type, const std::initializer_list<std::string_view> parts) -> void
         {
-            while(*value)
-            {
-                pushValue(*value);
-                ++value;
-            }
+            LogFileEntryHeader entry{type, 0};
+            for (const auto part : parts)
+                entry.length_ += static_cast<uint32_t>(part.size());
+            out.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+            for (const auto part : parts)
+                out.append(part);
         }
 
-        auto pushValue(const std::string &value) noexcept
+        template<typename T> static auto asBytes(const T &value) noexcept -> std::string_view
         {
-            pushValue(value.c_str());
+            return {reinterpret_cast<const char *>(&value), sizeof(T)};
         }
 
-        template< typename T, typename... A>
-        auto log(const char *s, const T &value, A... args) noexcept
+        /** Appends the BINARY mode entries of a record, preceded by the definitions of anything it uses for the first time. */
+        auto encodeRecord(std::string &out, const LogRecordHeader &header, const uint64_t *record) -> void
         {
-            while (*s)
-            {
-                if (*s == '%')
+            const auto format = recordFormat(record);
+            auto [format_itr, new_format] = format_ids_.try_emplace(format, static_cast<uint32_t>(format_ids_.size()));
+            if (new_format)
+                appendEntry(out, LogFileEntryType::FORMAT, {asBytes(format_itr -> second), std::string_view(format)});
+
+            LogFileRecord file_record{format_itr -> second, header.num_args_, 0};
+            memcpy(&file_record.time_, record + 2, sizeof(file_record.time_));
+
+            std::string args;
+            forEachLogArg(recordArgs(record), header.num_args_,
+                [](const uint64_t type_reference) { return structType(type_reference) -> size_; },
+                [&](const LogType type, const std::byte *payload, const size_t size)
                 {
-                    if (UNLIKELY(*(s+1) == '%'))
-                    {
-                        ++s;
-                    }
-                    else
+                    args += static_cast<char>(type);
+                    if (type != LogType::STRUCT)
                     {
-                        pushValue(value);
-                        log(s + 1, args...);
+                        args.append(reinterpret_cast<const char *>(payload), size);
                         return;
                     }
+
+                    const auto type_reference = readLogValue<uint64_t>(payload);
+                    auto [type_itr, new_type] = struct_type_ids_.try_emplace(type_reference, static_cast<uint32_t>(struct_type_ids_.size()));
+                    if (new_type)
+                        appendEntry(out, LogFileEntryType::STRUCT_TYPE,
+                            {asBytes(type_itr -> second), asBytes(structType(type_reference) -> size_), structType(type_reference) -> name_});
+
+                    const uint64_t type_id = type_itr -> second;
+                    args.append(asBytes(type_id));
+                    args.append(reinterpret_cast<const char *>(payload) + sizeof(uint64_t), size - sizeof(uint64_t));
+                });
+            appendEntry(out, LogFileEntryType::RECORD, {asBytes(file_record), args});
+        }
+    };
+
+    inline auto LogBackend::run() noexcept -> void
+    {
+        Nanos idle_sleep = 0;
+        while (running_)
+        {
+            TSCClock::instance().correct();
+
+            size_t num_records = 0;
+            {
+                const std::lock_guard<std::mutex> lock(mutex_);
+                for (const auto logger : loggers_)
+                    num_records += logger -> drain();
+
+                if (!num_records)
+                {
+                    for (const auto logger : loggers_)
+                        logger -> writeOut();
                 }
-                pushValue(*s++);
             }
-            FATAL("extra arguments provided to log()");
-        }
-        auto log(const char *s) noexcept
-        {
-           while (*s)
-           {
-               if (*s == '%')
-               {
-                   if (UNLIKELY(*(s + 1) == '%'))
-                   {
-                       ++s;
-                   }
-                   else
-                   {
-                       FATAL("missing arguments to log()");
-                   }
-               }
-               pushValue(*s++);
-           }
-        }
 
-        Logger() = delete;
-        Logger(const Logger &) = delete;
-        Logger &operator = (const Logger & ) = delete;
-        Logger &operator = (const Logger &&) = delete;
+            if (num_records)
+            {
+                idle_sleep = 0;
+                continue;
+            }
+            idle_sleep = std::clamp(idle_sleep * 2, MIN_IDLE_SLEEP, MAX_IDLE_SLEEP);
+            std::this_thread::sleep_for(std::chrono::nanoseconds(idle_sleep));
+        }
 
-    private:
-        const std::string file_name_;
-        std::ofstream file_;
-        LFQueue<LogElement> queue_;
-        std::atomic<bool> running_ = { true };
-        std::thread *logger_thread_ = nullptr;
-    };
+        const std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto logger : loggers_)
+        {
+            logger -> drain();
+            logger -> writeOut();
+        }
+    }
 }
 
-#endif //TRADINGECOSYSTEM_LOGGING_H
\ No newline at end of file
+#endif //TRADINGECOSYSTEM_LOGGING_H
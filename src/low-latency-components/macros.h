@@ -3,11 +3,13 @@
 #ifndef TRADINGECOSYSTEM_MACROS_H
 #define TRADINGECOSYSTEM_MACROS_H
 
-#define LIKELY  (x) __builtin_expect(!!(x), 1)
+#define LIKELY(x)   __builtin_expect(!!(x), 1)
 #define UNLIKELY(x) __builtin_expect(!!(x), 0)
 
 #include <iostream>
 
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+
 inline auto ASSERT(const bool cond, const std::string& msg) noexcept{
     if (UNLIKELY(!cond))
     {
@@ -3,28 +3,115 @@
 #ifndef TRADINGECOSYSTEM_MCAST_SOCKET_H
 #define TRADINGECOSYSTEM_MCAST_SOCKET_H
 
+#include <bit>
+#include <span>
+#include <memory>
 #include <vector>
 #include <string>
+#include <algorithm>
 #include <functional>
+#include <cerrno>
 #include <cstring>
 #include <unistd.h>
 #include <sys/socket.h>
 #include "low-latency-components/socket_utils.h"
 #include "low-latency-components/logging.h"
+#include "low-latency-components/io_uring.h"
 
 namespace Common {
     constexpr size_t McastBufferSize = 64 * 1024 * 1024;
+    /** Room for any UDP payload carried by a 1500 byte MTU, rounded up. */
+    constexpr size_t McastSlotSize = 2048;
+    /** Submission queue of an io_uring_ socket, which only ever has a recv re-arm or a cancel to submit. */
+    constexpr unsigned MCAST_URING_ENTRIES = 8;
+    /** user_data of completions nobody waits for, never a generation of the multishot recv. */
+    constexpr uint64_t MCAST_URING_IGNORE = ~0ULL;
+
+    struct McastSocketCfg {
+        /** Size of each flat inbound / outbound buffer, only allocated when num_slots_ is 0. */
+        size_t buffer_size_ = McastBufferSize;
+        /**
+         * Non zero switches to datagram mode: num_slots_ pre-allocated datagram slots of slot_size_ bytes each way,
+         * received with one recvmmsg() and sent with one sendmmsg() per batch, datagram boundaries preserved.
+         */
+        size_t num_slots_ = 0;
+        size_t slot_size_ = McastSlotSize;
+        /** SO_RCVBUF / SO_SNDBUF to ask for when non zero, capped by the kernel at rmem_max / wmem_max. */
+        int kernel_buffer_size_ = 0;
+        /** Datagram mode only: have the kernel stamp every received datagram (SO_TIMESTAMPNS). */
+        bool kernel_timestamps_ = false;
+        /**
+         * Datagram mode only: receive with one multishot recvmsg on an io_uring into num_slots_ (rounded up to a power
+         * of two) provided buffers, so polling an idle socket costs no syscall. Needs Linux 6.0+, sends stay on sendmmsg().
+         */
+        bool io_uring_ = false;
+    };
+
+    /** One datagram of a recvmmsg() batch, valid until the next sendAndRecv(). */
+    struct McastDatagram {
+        const char *data_ = nullptr;
+        size_t len_ = 0;
+        /** CLOCK_REALTIME nanos the kernel received the datagram at, 0 without kernel_timestamps_. */
+        Nanos kernel_rx_time_ = 0;
+    };
 
     struct McastSocket {
-        explicit McastSocket(Logger &logger)
-        : logger_(logger) {
-            outbound_data_.resize(McastBufferSize);
-            inbound_data_.resize(McastBufferSize);
+        explicit McastSocket(Logger &logger, const McastSocketCfg &cfg = {})
+        : cfg_(cfg), logger_(logger) {
+            if (!cfg_.num_slots_) {
+                outbound_data_.resize(cfg_.buffer_size_);
+                inbound_data_.resize(cfg_.buffer_size_);
+                return;
+            }
+
+            /** Point every mmsghdr at its slot once, only the lengths change per batch. */
+            const auto control_size = CMSG_SPACE(sizeof(timespec));
+            rx_slots_.resize(cfg_.num_slots_ * cfg_.slot_size_);
+            rx_control_.resize(cfg_.num_slots_ * control_size);
+            rx_iovs_.resize(cfg_.num_slots_);
+            rx_msgs_.resize(cfg_.num_slots_);
+            rx_datagrams_.resize(cfg_.num_slots_);
+            if (cfg_.io_uring_) {
+                const auto num_buffers = std::bit_ceil(static_cast<unsigned>(cfg_.num_slots_));
+                rx_datagrams_.resize(num_buffers);
+                rx_uring_bids_.resize(num_buffers);
+                uring_msg_.msg_controllen = control_size;
+                uring_ = std::make_unique<IOUring>(MCAST_URING_ENTRIES, 2 * num_buffers);
+                uring_buffers_ = std::make_unique<IOUringBufferRing>(*uring_, 0, num_buffers,
+                    sizeof(io_uring_recvmsg_out) + control_size + cfg_.slot_size_);
+            }
+            tx_slots_.resize(cfg_.num_slots_ * cfg_.slot_size_);
+            tx_iovs_.resize(cfg_.num_slots_);
+            tx_msgs_.resize(cfg_.num_slots_);
+            for (size_t i = 0; i < cfg_.num_slots_; ++i) {
+                rx_iovs_[i] = {rx_slots_.data() + i * cfg_.slot_size_, cfg_.slot_size_};
+                rx_msgs_[i].msg_hdr.msg_iov = &rx_iovs_[i];
+                rx_msgs_[i].msg_hdr.msg_iovlen = 1;
+                rx_msgs_[i].msg_hdr.msg_control = rx_control_.data() + i * control_size;
+                rx_msgs_[i].msg_hdr.msg_controllen = control_size;
+
+                tx_iovs_[i] = {tx_slots_.data() + i * cfg_.slot_size_, 0};
+                tx_msgs_[i].msg_hdr.msg_iov = &tx_iovs_[i];
+                tx_msgs_[i].msg_hdr.msg_iovlen = 1;
+            }
         }
 
         auto init(const std::string &ip, const std::string &iface, const int port, const bool is_listening) -> int {
             const SocketCfg socket_cfg{ip, iface, port, true, is_listening, false};
             socket_fd_ = CreateSocket(logger_, socket_cfg);
+
+            if (socket_fd_ >= 0 && cfg_.kernel_buffer_size_) {
+                ASSERT(setRecvBufferSize(socket_fd_, cfg_.kernel_buffer_size_) &&
+                    setSendBufferSize(socket_fd_, cfg_.kernel_buffer_size_),
+                    "Could not size mcast socket buffers. errno:" + std::string(strerror(errno)));
+            }
+            if (socket_fd_ >= 0 && cfg_.num_slots_ && cfg_.kernel_timestamps_) {
+                ASSERT(setSOTimestampNs(socket_fd_), "setSOTimestampNs() failed. errno:" + std::string(strerror(errno)));
+            }
+            if (socket_fd_ >= 0 && uring_) {
+                armUringRecv();
+                uring_->submit();
+            }
             return socket_fd_;
         }
 
@@ -33,15 +120,27 @@ namespace Common {
         }
 
         auto leave(const std::string &, int) -> void {
+            if (uring_) {
+                /** The multishot recv holds the socket open until cancelled, its late completions are told apart by generation. */
+                const auto sqe = uring_ -> getSqe();
+                sqe -> opcode = IORING_OP_ASYNC_CANCEL;
+                sqe -> addr = uring_generation_;
+                sqe -> user_data = MCAST_URING_IGNORE;
+                ++uring_generation_;
+                uring_ -> submit();
+            }
             close(socket_fd_);
             socket_fd_ = -1;
         }
 
         auto sendAndRecv() noexcept -> bool {
+            if (cfg_.num_slots_)
+                return sendAndRecvBatch();
+
             const ssize_t n_rcv = recv(
                 socket_fd_,
                 inbound_data_.data() + next_rcv_valid_index_,
-                McastBufferSize - next_rcv_valid_index_,
+                inbound_data_.size() - next_rcv_valid_index_,
                 MSG_DONTWAIT);
 
             if (n_rcv > 0) {
@@ -55,6 +154,22 @@ namespace Common {
                 recv_callback_(this);
             }
 
+            flush();
+            return n_rcv > 0;
+        }
+
+        /**
+         * Sends everything queued with send() since the last flush: as a single datagram, or in datagram mode as the
+         * datagrams ended with endDatagram() plus the one being filled, with one sendmmsg() per batch. In datagram
+         * mode whatever the kernel had no room for stays queued, pendingDatagrams() > 0, for the next call.
+         */
+        auto flush() noexcept -> void {
+            if (cfg_.num_slots_) {
+                endDatagram();
+                sendDatagrams();
+                return;
+            }
+
             if (next_send_valid_index_ > 0) {
                 const ssize_t n = ::send(socket_fd_,
                     outbound_data_.data(),
@@ -67,25 +182,235 @@ namespace Common {
                     n);
             }
             next_send_valid_index_ = 0;
-            return n_rcv > 0;
         }
 
         auto send(const void *data, const size_t len) noexcept -> void {
+            if (cfg_.num_slots_) {
+                if (tx_iovs_[num_tx_datagrams_].iov_len + len > cfg_.slot_size_)
+                    endDatagram();
+                auto &iov = tx_iovs_[num_tx_datagrams_];
+                if (UNLIKELY(len > cfg_.slot_size_))
+                    FATAL("Mcast datagram of " + std::to_string(len) + " bytes exceeds the slot size.");
+                memcpy(static_cast<char *>(iov.iov_base) + iov.iov_len, data, len);
+                iov.iov_len += len;
+                return;
+            }
+
             memcpy(outbound_data_.data() + next_send_valid_index_, data, len);
             next_send_valid_index_ += len;
-            ASSERT(next_send_valid_index_ < McastBufferSize,
+            ASSERT(next_send_valid_index_ < outbound_data_.size(),
                 "Mcast socket buffer filled up and sendAndRecv() not called.");
         }
 
+        /**
+         * Datagram mode: closes the datagram being filled, sending the batch if every slot is taken. With every slot
+         * still taken after that it keeps retrying until the kernel takes at least one, nothing is ever dropped.
+         */
+        auto endDatagram() noexcept -> void {
+            if (!tx_iovs_[num_tx_datagrams_].iov_len)
+                return;
+            if (++num_tx_datagrams_ < cfg_.num_slots_)
+                return;
+            while (num_tx_datagrams_ == cfg_.num_slots_)
+                sendDatagrams();
+        }
+
+        /**
+         * Datagram mode: sends only the datagrams already ended, leaving the one being filled open. Those the kernel
+         * has no buffer space for (EAGAIN / ENOBUFS) move to the front of the slots, in order, to be sent first next
+         * time. Only a datagram failing with any other error, which every retry would hit again, is dropped.
+         */
+        auto sendDatagrams() noexcept -> void {
+            size_t num_sent = 0;
+            while (num_sent < num_tx_datagrams_) {
+                const auto n = sendmmsg(socket_fd_, tx_msgs_.data() + num_sent, num_tx_datagrams_ - num_sent,
+                    MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (n > 0) {
+                    num_sent += n;
+                    continue;
+                }
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+                    break;
+                logger_.log("%:% %() % sendmmsg socket: % failed, dropping a datagram. errno: %\n",
+                    __FILE__, __LINE__, __func__,
+                    getCurrentTimeStr(&time_str_),
+                    socket_fd_,
+                    strerror(errno));
+                ++num_sent;
+            }
+            if (num_sent) {
+                logger_.log("%:% %() % sendmmsg socket: %, datagrams: % of %\n",
+                    __FILE__, __LINE__, __func__,
+                    getCurrentTimeStr(&time_str_),
+                    socket_fd_,
+                    num_sent,
+                    num_tx_datagrams_);
+            }
+
+            /**
+             * The unsent datagrams, then the open one, if any, rotate to the front by swapping the slots' iovecs, the
+             * mmsghdrs keep pointing at the same iovecs. The sent slots end up behind them, emptied.
+             */
+            const auto num_used = std::min(num_tx_datagrams_ + 1, cfg_.num_slots_);
+            std::rotate(tx_iovs_.begin(), tx_iovs_.begin() + static_cast<ptrdiff_t>(num_sent),
+                tx_iovs_.begin() + static_cast<ptrdiff_t>(num_used));
+            num_tx_datagrams_ -= num_sent;
+            for (auto i = num_used - num_sent; i < num_used; ++i)
+                tx_iovs_[i].iov_len = 0;
+        }
+
+        /** Datagram mode: number of ended datagrams waiting for sendDatagrams() or flush(). */
+        [[nodiscard]]
+        auto pendingDatagrams() const noexcept { return num_tx_datagrams_; }
+
+        const McastSocketCfg cfg_;
         int socket_fd_ = -1;
         std::vector<char> outbound_data_;
         size_t next_send_valid_index_ = 0;
         std::vector<char> inbound_data_;
         size_t next_rcv_valid_index_ = 0;
         std::function<void(McastSocket *s)> recv_callback_ = nullptr;
+        /** Datagram mode: called with each non empty recvmmsg() batch. */
+        std::function<void(McastSocket *s, std::span<const McastDatagram> datagrams)> recv_datagrams_callback_ = nullptr;
         std::string time_str_;
         Logger &logger_;
+
+    private:
+        std::vector<char> rx_slots_;
+        std::vector<char> rx_control_;
+        std::vector<iovec> rx_iovs_;
+        std::vector<mmsghdr> rx_msgs_;
+        std::vector<McastDatagram> rx_datagrams_;
+
+        /** io_uring_ only: buffer ids of the datagrams last handed to recv_datagrams_callback_, recycled on the next batch. */
+        std::vector<uint16_t> rx_uring_bids_;
+        size_t num_rx_uring_bids_ = 0;
+        std::unique_ptr<IOUring> uring_;
+        std::unique_ptr<IOUringBufferRing> uring_buffers_;
+        msghdr uring_msg_{};
+        /** user_data of the current multishot recv, bumped by leave(). */
+        uint64_t uring_generation_ = 0;
+
+        std::vector<char> tx_slots_;
+        std::vector<iovec> tx_iovs_;
+        std::vector<mmsghdr> tx_msgs_;
+        size_t num_tx_datagrams_ = 0;
+
+        auto armUringRecv() noexcept -> void {
+            const auto sqe = uring_ -> getSqe();
+            sqe -> opcode = IORING_OP_RECVMSG;
+            sqe -> fd = socket_fd_;
+            sqe -> addr = reinterpret_cast<uint64_t>(&uring_msg_);
+            sqe -> flags = IOSQE_BUFFER_SELECT;
+            sqe -> ioprio = IORING_RECV_MULTISHOT;
+            sqe -> buf_group = uring_buffers_ -> group();
+            sqe -> user_data = uring_generation_;
+        }
+
+        /**
+         * io_uring_ batch: every datagram completed since the last call, read out of its provided buffer laid out as
+         * io_uring_recvmsg_out, then the control data, then the payload. The buffers go back to the kernel on the next call.
+         */
+        auto sendAndRecvUring() noexcept -> bool {
+            for (size_t i = 0; i < num_rx_uring_bids_; ++i)
+                uring_buffers_ -> recycle(rx_uring_bids_[i]);
+            if (num_rx_uring_bids_)
+                uring_buffers_ -> publish();
+            num_rx_uring_bids_ = 0;
+
+            uring_ -> submit();
+
+            bool rearm = false;
+            uring_ -> forEachCqe([this, &rearm](const io_uring_cqe &cqe) {
+                const auto has_buffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+                const auto bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                if (cqe.user_data != uring_generation_) {
+                    if (has_buffer)
+                        uring_buffers_ -> recycle(bid);
+                    return;
+                }
+                if (!(cqe.flags & IORING_CQE_F_MORE))
+                    rearm = true;
+                if (cqe.res <= 0 || !has_buffer)
+                    return;
+
+                const auto buffer = uring_buffers_ -> buffer(bid);
+                const auto out = reinterpret_cast<const io_uring_recvmsg_out *>(buffer);
+                const auto control = buffer + sizeof(io_uring_recvmsg_out) + uring_msg_.msg_namelen;
+                const auto payload = control + uring_msg_.msg_controllen;
+                const auto payload_len = std::min<size_t>(out -> payloadlen, buffer + cqe.res - payload);
+
+                auto &datagram = rx_datagrams_[num_rx_uring_bids_];
+                datagram = {payload, payload_len, 0};
+                msghdr msg{};
+                msg.msg_control = const_cast<char *>(control);
+                msg.msg_controllen = out -> controllen;
+                for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                    if (cmsg -> cmsg_level == SOL_SOCKET && cmsg -> cmsg_type == SCM_TIMESTAMPNS) {
+                        timespec ts{};
+                        memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                        datagram.kernel_rx_time_ = ts.tv_sec * NANOS_TO_SECS + ts.tv_nsec;
+                    }
+                }
+                rx_uring_bids_[num_rx_uring_bids_++] = bid;
+            });
+            uring_buffers_ -> publish();
+
+            /** The multishot recv ended, e.g. it ran out of buffers: re-armed now, submitted with the next batch. */
+            if (rearm && socket_fd_ >= 0)
+                armUringRecv();
+
+            if (num_rx_uring_bids_) {
+                logger_.log("%:% %() % io_uring recvmsg socket: %, datagrams: %\n",
+                    __FILE__, __LINE__, __func__,
+                    getCurrentTimeStr(&time_str_),
+                    socket_fd_,
+                    num_rx_uring_bids_);
+                recv_datagrams_callback_(this, {rx_datagrams_.data(), num_rx_uring_bids_});
+            }
+
+            flush();
+            return num_rx_uring_bids_ > 0;
+        }
+
+        auto sendAndRecvBatch() noexcept -> bool {
+            if (uring_)
+                return sendAndRecvUring();
+
+            const auto n_rcv = recvmmsg(socket_fd_, rx_msgs_.data(), cfg_.num_slots_, MSG_DONTWAIT, nullptr);
+
+            if (n_rcv > 0) {
+                const auto control_size = CMSG_SPACE(sizeof(timespec));
+                for (int i = 0; i < n_rcv; ++i) {
+                    auto &msg = rx_msgs_[i];
+                    auto &datagram = rx_datagrams_[i];
+                    datagram = {static_cast<const char *>(rx_iovs_[i].iov_base), msg.msg_len, 0};
+
+                    for (auto cmsg = CMSG_FIRSTHDR(&msg.msg_hdr); cmsg; cmsg = CMSG_NXTHDR(&msg.msg_hdr, cmsg)) {
+                        if (cmsg -> cmsg_level == SOL_SOCKET && cmsg -> cmsg_type == SCM_TIMESTAMPNS) {
+                            timespec ts{};
+                            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                            datagram.kernel_rx_time_ = ts.tv_sec * NANOS_TO_SECS + ts.tv_nsec;
+                        }
+                    }
+                    /** The kernel shrinks msg_controllen to what it wrote. */
+                    msg.msg_hdr.msg_controllen = control_size;
+                }
+
+                logger_.log("%:% %() % recvmmsg socket: %, datagrams: %\n",
+                    __FILE__, __LINE__, __func__,
+                    getCurrentTimeStr(&time_str_),
+                    socket_fd_,
+                    n_rcv);
+                recv_datagrams_callback_(this, {rx_datagrams_.data(), static_cast<size_t>(n_rcv)});
+            }
+
+            flush();
+            return n_rcv > 0;
+        }
     };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -3,45 +3,80 @@
 #ifndef TRADINGECOSYSTEM_MEM_POOL_H
 #define TRADINGECOSYSTEM_MEM_POOL_H
 
-#include <vector>
+#include <new>
 #include <string>
+#include <cerrno>
+#include <cstring>
+#include <cstddef>
+#include <sys/mman.h>
 #include "macros.h"
 
 namespace Common
 {
+    constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
     template< typename T> class MemPool final
     {
     public:
-        explicit MemPool(std::size_t num_elems) :
-            store_(num_elems, {T(), true}) /* pre-allocation of vector storage */
+        /**
+         * Maps storage for num_elems objects up front, preferring explicit huge pages and falling back to
+         * transparent huge pages, and touches every page while threading the free list through the blocks,
+         * so no page fault is taken on the allocation path.
+         */
+        explicit MemPool(std::size_t num_elems, const bool use_huge_pages = true) :
+            num_elems_(num_elems)
+            {
+                ASSERT(num_elems_ > 0, "Memory Pool needs at least one element.");
+                mapStorage(use_huge_pages);
+
+                for (size_t i = 0; i + 1 < num_elems_; ++i)
+                    store_[i].next_free_ = &store_[i + 1];
+                store_[num_elems_ - 1].next_free_ = nullptr;
+                free_list_ = &store_[0];
+            }
+
+            ~MemPool()
             {
-                ASSERT(reinterpret_cast< const ObjectBlock *> (&store_[0].object_) == & store_[0],
-                    "T object should be first member of ObjectBlock.");
+                munmap(store_, mapped_bytes_);
+                store_ = free_list_ = nullptr;
             }
 
             template< typename... Args>
             T *allocate(Args... args) noexcept
             {
-                auto obj_block = &store_[next_free_index_];
-                ASSERT(obj_block -> is_free_, "Expected free ObjectBlock at index: "
-                    + std::to_string(next_free_index_));
-                T *ret = &obj_block -> object_;
-                ret = new(ret) T(args...);
-                obj_block -> is_free_ = false;
-
-                updateNextFreeIndex();
-                return ret;
+                ASSERT(free_list_ != nullptr, "Memory Pool out of space.");
+                const auto obj_block = free_list_;
+                free_list_ = obj_block -> next_free_;
+
+                if (++in_use_ > high_water_mark_)
+                    high_water_mark_ = in_use_;
+                return new(obj_block -> storage_) T(args...);
             }
             auto deallocate(const T * elem) noexcept
             {
-                const auto elem_index = reinterpret_cast<const ObjectBlock *>(elem) - &store_[0];
-                ASSERT(elem_index >= 0 && static_cast<size_t>(elem_index) < store_.size(),
+                const auto obj_block = reinterpret_cast<ObjectBlock *>(const_cast<T *>(elem));
+                const auto elem_index = obj_block - store_;
+                ASSERT(elem_index >= 0 && static_cast<size_t>(elem_index) < num_elems_,
                       "Element being deallocated does not belong to this Memory pool.");
-                ASSERT(!store_[elem_index].is_free_, "Expected in-use ObjectBlock at index: "
-                       + std::to_string(elem_index));
-                store_[elem_index].is_free_ = true;
+                elem -> ~T();
+
+                obj_block -> next_free_ = free_list_;
+                free_list_ = obj_block;
+                --in_use_;
             }
 
+            [[nodiscard]]
+            auto capacity() const noexcept { return num_elems_; }
+
+            [[nodiscard]]
+            auto inUse() const noexcept { return in_use_; }
+
+            [[nodiscard]]
+            auto highWaterMark() const noexcept { return high_water_mark_; }
+
+            [[nodiscard]]
+            auto usesHugePages() const noexcept { return huge_pages_; }
+
         MemPool() = delete;
         MemPool(const MemPool& ) = delete;
         MemPool(const MemPool&&) = delete;
@@ -49,31 +84,43 @@ namespace Common
         MemPool& operator=(const MemPool&&) = delete;
 
     private:
-        struct ObjectBlock
+        /** A free block stores the link to the next free one in the object's own storage. */
+        union ObjectBlock
         {
-            T object_;
-            bool is_free_ = true;
+            alignas(T) std::byte storage_[sizeof(T)];
+            ObjectBlock *next_free_;
         };
-        std::vector<ObjectBlock> store_;
-        size_t next_free_index_ = 0;
 
-        auto updateNextFreeIndex() noexcept
+        ObjectBlock *store_ = nullptr;
+        ObjectBlock *free_list_ = nullptr;
+        const size_t num_elems_;
+        size_t mapped_bytes_ = 0;
+        size_t in_use_ = 0;
+        size_t high_water_mark_ = 0;
+        bool huge_pages_ = false;
+
+        auto mapStorage(const bool use_huge_pages) noexcept -> void
         {
-            const auto initial_free_index = next_free_index_;
-            while (!store_[next_free_index_].is_free_)
-            {
-                ++ next_free_index_;
-                if (UNLIKELY(next_free_index_ == store_.size()))
-                {
-                    /** Hardware brach predictor should almost always predict this to be false any ways */
-                    next_free_index_ = 0;
-                }
-                if (UNLIKELY(initial_free_index == next_free_index_))
-                {
-                    ASSERT(initial_free_index != next_free_index_, "Memory Pool out of space.");
-                }
+            const auto bytes = num_elems_ * sizeof(ObjectBlock);
+            void *storage = MAP_FAILED;
+
+            if (use_huge_pages) {
+                mapped_bytes_ = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+                storage = mmap(nullptr, mapped_bytes_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+                huge_pages_ = storage != MAP_FAILED;
+            }
+
+            if (storage == MAP_FAILED) {
+                /** No reserved huge pages, ask for transparent ones before the pages are first touched. */
+                mapped_bytes_ = bytes;
+                storage = mmap(nullptr, mapped_bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                ASSERT(storage != MAP_FAILED, "Memory Pool mmap() failed. errno:" + std::string(std::strerror(errno)));
+                if (use_huge_pages)
+                    madvise(storage, mapped_bytes_, MADV_HUGEPAGE);
             }
+            store_ = static_cast<ObjectBlock *>(storage);
         }
     };
 }
-#endif //TRADINGECOSYSTEM_MEM_POOL_H
\ No newline at end of file
+#endif //TRADINGECOSYSTEM_MEM_POOL_H
@@ -91,6 +91,25 @@ namespace Common
         return setsockopt(fd, SOL_SOCKET, SO_TIMESTAMP, &one, sizeof(one)) != -1;
     }
 
+    /** Asks for a kernel receive buffer of size bytes, which the kernel caps at net.core.rmem_max. */
+    inline auto setRecvBufferSize(const int fd, const int size) -> bool
+    {
+        return setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) != -1;
+    }
+
+    /** Asks for a kernel send buffer of size bytes, which the kernel caps at net.core.wmem_max. */
+    inline auto setSendBufferSize(const int fd, const int size) -> bool
+    {
+        return setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) != -1;
+    }
+
+    /** Nanosecond receive timestamps, delivered as an SCM_TIMESTAMPNS control message. */
+    inline auto setSOTimestampNs(const int fd) -> bool
+    {
+        constexpr int one = 1;
+        return setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) != -1;
+    }
+
     inline auto wouldBlock() -> bool
     {
         return errno == EWOULDBLOCK || errno == EINPROGRESS;
@@ -4,62 +4,244 @@
 #define TRADINGECOSYSTEM_TCP_SERVER_H
 
 #include "tcp_socket.h"
+#include "io_uring.h"
+#include "buffer_arena.h"
 #include <sys/epoll.h>
 #include <algorithm>
+#include <bit>
+#include <memory>
 
 namespace Common
 {
+    /** Most events taken from epoll_wait() per poll(), which asks for no more than there are live connections. */
+    constexpr size_t TCP_MAX_EPOLL_EVENTS = 1024;
+    constexpr size_t TCP_MAX_CONNECTIONS = 256;
+    constexpr size_t TCP_CONNECTION_BUFFER_SIZE = 64 * 1024;
+    constexpr unsigned TCP_URING_RECV_BUFFERS = 1024;
+    constexpr size_t TCP_URING_RECV_BUFFER_SIZE = 16 * 1024;
+    constexpr uint16_t TCP_URING_BUFFER_GROUP = 0;
+
+    /** Event loop behind TCPServer::poll() / sendAndRecv(), the callbacks and TCPSocket interface are the same for both. */
+    enum class TCPBackend : uint8_t
+    {
+        /** epoll_wait() per poll(), recvmsg() / sendmsg() per ready socket. */
+        EPOLL = 0,
+        /**
+         * io_uring (Linux 6.0+): multishot accept, multishot recv into a provided buffer ring, connections in the fixed
+         * file table and their sends batched into the submission queue, at most one io_uring_enter() per poll().
+         */
+        IO_URING = 1
+    };
+
+    struct TCPServerCfg
+    {
+        TCPBackend backend_ = TCPBackend::EPOLL;
+        /** Connections accepted at once, further ones are closed right away. */
+        size_t max_connections_ = TCP_MAX_CONNECTIONS;
+        /** Per connection receive ring (rounded up to whole pages) / send ring, a message never exceeds either. */
+        size_t recv_buffer_size_ = TCP_CONNECTION_BUFFER_SIZE;
+        size_t send_buffer_size_ = TCP_CONNECTION_BUFFER_SIZE;
+        /**
+         * Unsent bytes a connection may build up before it is disconnected as a slow consumer, 0 for its whole send buffer.
+         * With IO_URING the bytes of a send still in flight count too.
+         */
+        size_t send_high_water_mark_ = 0;
+        /** IO_URING only: receive buffers shared by every connection (a power of two) and their size. */
+        unsigned uring_recv_buffers_ = TCP_URING_RECV_BUFFERS;
+        size_t uring_recv_buffer_size_ = TCP_URING_RECV_BUFFER_SIZE;
+    };
+
+    /** io_uring state of one pooled connection, indexed by TCPSocket::pool_index_. */
+    struct TCPUringConnection
+    {
+        /** Bumped when the connection closes, completions tagged with an older one are stale. */
+        uint32_t generation_ = 0;
+        /** A connection has at most one send in flight, its msghdr and iovecs live here until it completes. */
+        bool send_in_flight_ = false;
+        iovec send_iov_[2]{};
+        msghdr send_msg_{};
+    };
+
+    /** What an io_uring completion is for, in the top byte of its user_data. */
+    enum class TCPUringOp : uint8_t
+    {
+        IGNORE = 0,
+        ACCEPT = 1,
+        RECV = 2,
+        SEND = 3
+    };
+
+    /**
+     * Builds max_connections_ TCPSockets up front, their send buffers carved from one pre-faulted BufferArena and their
+     * mirrored receive rings from one MirroredBufferArena, and hands them out from a free list on accept and takes them
+     * back on disconnect, so accepting never allocates.
+     */
     struct TCPServer
     {
-        explicit TCPServer(Logger &logger)
-            : listener_socket_(logger), logger_(logger)
-        {}
-        auto addToEpollList(TCPSocket *socket) const {
+        explicit TCPServer(Logger &logger, const TCPServerCfg &cfg = {})
+            : backend_(cfg.backend_),
+              listener_socket_(logger, 0),
+              recv_arena_(cfg.max_connections_, cfg.recv_buffer_size_),
+              send_arena_(BufferArena::capacityFor(cfg.max_connections_, cfg.send_buffer_size_)),
+              logger_(logger)
+        {
+            ASSERT(cfg.max_connections_ > 0, "TCPServer needs room for at least one connection.");
+            ASSERT(cfg.send_high_water_mark_ <= cfg.send_buffer_size_, "TCPServer send high water mark exceeds its send buffer.");
+            sockets_.reserve(cfg.max_connections_);
+            for (size_t i = 0; i < cfg.max_connections_; ++i)
+            {
+                const auto inbound_data = recv_arena_.carve();
+                const auto outbound_data = send_arena_.carve(cfg.send_buffer_size_);
+                sockets_.push_back(new TCPSocket(logger_, inbound_data, outbound_data));
+                sockets_.back()->pool_index_ = static_cast<uint32_t>(i);
+                sockets_.back()->send_list_ = &send_sockets_;
+                sockets_.back()->disconnect_list_ = &disconnected_sockets_;
+                if (cfg.send_high_water_mark_)
+                    sockets_.back()->send_high_water_mark_ = cfg.send_high_water_mark_;
+            }
+            free_sockets_.assign(sockets_.rbegin(), sockets_.rend());
+
+            if (backend_ == TCPBackend::IO_URING)
+            {
+                /** Room for a send and a recv re-arm per connection per loop, and a completion per receive buffer on top. */
+                const auto sq_entries = std::bit_ceil(2 * static_cast<unsigned>(cfg.max_connections_) + 16);
+                uring_ = std::make_unique<IOUring>(sq_entries, std::bit_ceil(2 * sq_entries + cfg.uring_recv_buffers_));
+                uring_buffers_ = std::make_unique<IOUringBufferRing>(*uring_, TCP_URING_BUFFER_GROUP,
+                    cfg.uring_recv_buffers_, cfg.uring_recv_buffer_size_);
+                ASSERT(uring_->registerFiles(static_cast<unsigned>(cfg.max_connections_)),
+                    "io_uring fixed file registration failed. errno:" + std::string(std::strerror(errno)));
+                uring_connections_.resize(cfg.max_connections_);
+            }
+        }
+
+        ~TCPServer()
+        {
+            for (const auto socket : sockets_)
+            {
+                if (socket->socket_fd_ >= 0)
+                    close(socket->socket_fd_);
+                delete socket;
+            }
+            if (epoll_fd_ >= 0)
+                close(epoll_fd_);
+        }
+
+        /**
+         * Connections are registered for EPOLLOUT up front: edge triggered, it only fires once a send hit a full kernel
+         * buffer and room came back, so backpressure never costs an epoll_ctl() per blocked flush.
+         */
+        auto addToEpollList(TCPSocket *socket, const uint32_t events = EPOLLIN | EPOLLOUT | EPOLLRDHUP) const {
             epoll_event ev{};
-            ev.events = static_cast<uint32_t>(EPOLLET | EPOLLIN);
+            ev.events = static_cast<uint32_t>(EPOLLET) | events;
             ev.data.ptr = reinterpret_cast<void *>(socket);
             return !epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, socket->socket_fd_, &ev);
         }
 
         void listen(const std::string &iface, const int port)
         {
-            epoll_fd_ = epoll_create(1);
-
-            ASSERT(epoll_fd_ >= 0,
-                   "epoll_create() failed error:" + std::string(std::strerror(errno)));
-
             ASSERT(listener_socket_.connect("", iface, port, true) >= 0,
                    "Listener socket failed to connect. iface:" + iface +
                    " port:" + std::to_string(port) +
                    " error:" + std::string(std::strerror(errno)));
 
-            ASSERT(addToEpollList(&listener_socket_),
+            if (backend_ == TCPBackend::IO_URING)
+            {
+                armUringAccept();
+                uring_->submit();
+                return;
+            }
+
+            epoll_fd_ = epoll_create(1);
+
+            ASSERT(epoll_fd_ >= 0,
+                   "epoll_create() failed error:" + std::string(std::strerror(errno)));
+
+            ASSERT(addToEpollList(&listener_socket_, EPOLLIN),
                    "epoll_ctl() failed. error:" + std::string(std::strerror(errno)));
         }
 
+        /**
+         * Reads every socket on the receive list until it would block, calls recv_finished_callback_ if anything
+         * was read, flushes every socket on the send list, then closes the sockets that hung up or whose output closed.
+         * A flush the kernel cannot take in full leaves the socket off the send list until EPOLLOUT.
+         * Costs O(ready sockets), idle connections are never touched.
+         */
         void sendAndRecv() noexcept
         {
+            if (backend_ == TCPBackend::IO_URING)
+            {
+                sendAndRecvUring();
+                return;
+            }
+
             bool recv = false;
 
-            std::for_each(receive_sockets_.begin(), receive_sockets_.end(),
-                [&recv](auto socket)
+            for (auto socket = receive_sockets_.head(); socket; )
+            {
+                const auto next = receive_sockets_.next(socket);
+                const auto read_size = socket->receive();
+                if (read_size > 0)
+                {
+                    recv = true;
+                }
+                else
                 {
-                    recv |= socket->sendAndRecv();
-                });
+                    /** Edge triggered: the socket stays ready until a read would block. */
+                    receive_sockets_.remove(socket);
+                    const auto has_room = socket->pendingRecv() < socket->inbound_data_.size();
+                    if ((read_size == 0 && has_room) || (read_size < 0 && !wouldBlock() && errno != EINTR))
+                        disconnected_sockets_.push(socket);
+                }
+                socket = next;
+            }
 
             if (recv)
                 recv_finished_callback_();
 
-            std::for_each(send_sockets_.begin(), send_sockets_.end(),
-                [](auto socket)
-                {
-                    socket->sendAndRecv();
-                });
+            while (const auto socket = send_sockets_.head())
+            {
+                send_sockets_.remove(socket);
+                socket->flush();
+            }
+
+            while (const auto socket = disconnected_sockets_.head())
+                removeSocket(socket);
+        }
+
+        /** Closes a socket whose peer hung up and returns it to the pool, once whatever it still had buffered has been received. */
+        auto removeSocket(TCPSocket *socket) noexcept -> void
+        {
+            logger_.log("%:% %() % removing socket: %.\n",
+                __FILE__, __LINE__, __func__,
+                getCurrentTimeStr(&time_str_),
+                socket->socket_fd_);
+
+            if (disconnect_callback_)
+                disconnect_callback_(socket);
+
+            receive_sockets_.remove(socket);
+            send_sockets_.remove(socket);
+            disconnected_sockets_.remove(socket);
+            --num_connections_;
+
+            if (backend_ == TCPBackend::IO_URING)
+                closeUringConnection(socket);
+            else
+                epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, socket->socket_fd_, nullptr);
+            close(socket->socket_fd_);
+            socket->reset(-1);
+            free_sockets_.push_back(socket);
         }
 
         void poll() noexcept
         {
-            const int max_events = 1 + static_cast<int>(send_sockets_.size()) + static_cast<int>(receive_sockets_.size());
+            if (backend_ == TCPBackend::IO_URING)
+            {
+                pollUring();
+                return;
+            }
+
+            const int max_events = static_cast<int>(std::min(1 + num_connections_, TCP_MAX_EPOLL_EVENTS));
 
             const int n = epoll_wait(epoll_fd_, events_, max_events, 0);
 
@@ -70,9 +252,9 @@ namespace Common
                 const auto &[events, data] = events_[i];
                 auto socket = static_cast<TCPSocket *>(data.ptr);
 
-                if (events & EPOLLIN)
+                if (socket == &listener_socket_)
                 {
-                    if (socket == &listener_socket_)
+                    if (events & EPOLLIN)
                     {
                         logger_.log("%:% %() % EPOLL-IN listener_socket: %.\n",
                             __FILE__, __LINE__, __func__,
@@ -80,53 +262,43 @@ namespace Common
                             socket->socket_fd_);
 
                         have_new_connection = true;
-                        continue;
                     }
+                    continue;
+                }
 
+                if (events & EPOLLIN)
+                {
                     logger_.log("%:% %() % EPOLL-IN socket: %.\n",
                         __FILE__, __LINE__, __func__,
                         getCurrentTimeStr(&time_str_),
                         socket->socket_fd_);
 
-                    if (std::find(receive_sockets_.begin(),
-                                  receive_sockets_.end(),
-                                  socket) == receive_sockets_.end())
-                    {
-                        receive_sockets_.push_back(socket);
-                    }
+                    receive_sockets_.push(socket);
                 }
 
                 if (events & EPOLLOUT)
                 {
-                    logger_.log("%:% %() % EPOLL-OUT socket: %.\n",
+                    logger_.log("%:% %() % EPOLL-OUT socket: %, pending: %.\n",
                         __FILE__, __LINE__, __func__,
                         getCurrentTimeStr(&time_str_),
-                        socket->socket_fd_);
+                        socket->socket_fd_,
+                        socket->pendingSend());
 
-                    if (std::find(send_sockets_.begin(),
-                                  send_sockets_.end(),
-                                  socket) == send_sockets_.end())
-                    {
-                        send_sockets_.push_back(socket);
-                    }
+                    socket->unblockSend();
                 }
 
-                if (events & (EPOLLERR | EPOLLHUP))
+                if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
                 {
                     logger_.log("%:% %() % EPOLL-ERR socket: % \n",
                         __FILE__, __LINE__, __func__,
                         getCurrentTimeStr(&time_str_),
                         socket->socket_fd_);
 
-                    if (std::find(receive_sockets_.begin(),
-                                  receive_sockets_.end(),
-                                  socket) == receive_sockets_.end())
-                    {
-                        receive_sockets_.push_back(socket);
-                    }
+                    /** Read what is still buffered before the socket is closed. */
+                    receive_sockets_.push(socket);
+                    disconnected_sockets_.push(socket);
                 }
             }
-
             while (have_new_connection)
             {
                 logger_.log("%:% %() % have_new_connection\n",
@@ -143,30 +315,280 @@ namespace Common
                 if (fd == -1)
                     break;
 
-                ASSERT(setNonBlocking(fd) && disableNagle(fd),
-                    "Failed to set non-blocking or no-delay on socket: " +
-                    std::to_string(fd));
+                const auto socket = acceptConnection(fd);
+                if (!socket)
+                    continue;
+
+                ASSERT(addToEpollList(socket),
+                    "Unable to add socket. error:" +
+                    std::string(std::strerror(errno)));
 
-                logger_.log("%:% %() % accepted socket: %.\n",
+                receive_sockets_.push(socket);
+            }
+        }
+
+        /** Takes a pooled socket for the newly accepted fd, or closes fd and returns nullptr if every one is in use. */
+        auto acceptConnection(const int fd) noexcept -> TCPSocket*
+        {
+            if (UNLIKELY(free_sockets_.empty()))
+            {
+                logger_.log("%:% %() % rejecting socket: %, all % connections in use.\n",
                     __FILE__, __LINE__, __func__,
                     getCurrentTimeStr(&time_str_),
-                    fd);
+                    fd,
+                    sockets_.size());
+                close(fd);
+                return nullptr;
+            }
 
-                auto socket = new TCPSocket(logger_);
-                socket -> socket_fd_ = fd;
-                socket -> recv_callback_ = recv_callback_;
+            ASSERT(setNonBlocking(fd) && disableNagle(fd),
+                "Failed to set non-blocking or no-delay on socket: " +
+                std::to_string(fd));
+
+            logger_.log("%:% %() % accepted socket: %.\n",
+                __FILE__, __LINE__, __func__,
+                getCurrentTimeStr(&time_str_),
+                fd);
+
+            const auto socket = free_sockets_.back();
+            free_sockets_.pop_back();
+            socket -> reset(fd);
+            socket -> recv_callback_ = recv_callback_;
+            ++num_connections_;
+            return socket;
+        }
 
-                ASSERT(addToEpollList(socket),
-                    "Unable to add socket. error:" +
-                    std::string(std::strerror(errno)));
+        /**
+         * io_uring poll(): enters the kernel only if completions are waiting on it, then handles every completion:
+         * accepted connections get their fixed file slot and a multishot recv, received data is handed to the socket's
+         * recv_callback_ and its buffer recycled, finished sends release the socket's next flush.
+         */
+        auto pollUring() noexcept -> void
+        {
+            uring_->submit();
+            uring_->forEachCqe([this](const io_uring_cqe &cqe) {
+                onUringCompletion(cqe);
+            });
+            uring_buffers_->publish();
+        }
+
+        /**
+         * io_uring sendAndRecv(): calls recv_finished_callback_ if pollUring() delivered anything, queues one sendmsg
+         * of its whole output ring per socket on the send list, closes the sockets that hung up or whose output closed,
+         * then submits all of it with a single io_uring_enter().
+         */
+        auto sendAndRecvUring() noexcept -> void
+        {
+            if (uring_received_)
+            {
+                uring_received_ = false;
+                recv_finished_callback_();
+            }
+
+            while (const auto socket = send_sockets_.head())
+            {
+                send_sockets_.remove(socket);
+                queueUringSend(socket);
+            }
+
+            while (const auto socket = disconnected_sockets_.head())
+                removeSocket(socket);
+
+            uring_->submit();
+        }
 
-                if (std::find(receive_sockets_.begin(),
-                              receive_sockets_.end(),
-                              socket) == receive_sockets_.end())
+        static auto uringUserData(const TCPUringOp op, const uint32_t index = 0, const uint32_t generation = 0) noexcept -> uint64_t
+        {
+            return static_cast<uint64_t>(op) << 56 | static_cast<uint64_t>(generation & 0xFFFFFF) << 32 | index;
+        }
+
+        auto armUringAccept() noexcept -> void
+        {
+            const auto sqe = uring_->getSqe();
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->fd = listener_socket_.socket_fd_;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe->user_data = uringUserData(TCPUringOp::ACCEPT);
+        }
+
+        auto armUringRecv(const TCPSocket *socket) noexcept -> void
+        {
+            const auto sqe = uring_->getSqe();
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = static_cast<int>(socket->pool_index_);
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->buf_group = uring_buffers_->group();
+            sqe->user_data = uringUserData(TCPUringOp::RECV, socket->pool_index_,
+                uring_connections_[socket->pool_index_].generation_);
+        }
+
+        /** Puts the socket's fd in its fixed file slot, then starts its multishot recv once that is done. */
+        auto openUringConnection(const TCPSocket *socket) noexcept -> void
+        {
+            const auto sqe = uring_->getSqe();
+            sqe->opcode = IORING_OP_FILES_UPDATE;
+            sqe->fd = -1;
+            sqe->addr = reinterpret_cast<uint64_t>(&socket->socket_fd_);
+            sqe->len = 1;
+            sqe->off = socket->pool_index_;
+            sqe->flags = IOSQE_IO_LINK;
+            sqe->user_data = uringUserData(TCPUringOp::IGNORE);
+            armUringRecv(socket);
+        }
+
+        /** Cancels whatever is still in flight on the socket's fixed file and empties its slot, so the fd can be closed. */
+        auto closeUringConnection(const TCPSocket *socket) noexcept -> void
+        {
+            auto &connection = uring_connections_[socket->pool_index_];
+            ++connection.generation_;
+            connection.send_in_flight_ = false;
+
+            auto sqe = uring_->getSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = static_cast<int>(socket->pool_index_);
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_FD_FIXED | IORING_ASYNC_CANCEL_ALL;
+            sqe->user_data = uringUserData(TCPUringOp::IGNORE);
+
+            sqe = uring_->getSqe();
+            sqe->opcode = IORING_OP_FILES_UPDATE;
+            sqe->fd = -1;
+            sqe->addr = reinterpret_cast<uint64_t>(&TCP_URING_EMPTY_FILE);
+            sqe->len = 1;
+            sqe->off = socket->pool_index_;
+            sqe->user_data = uringUserData(TCPUringOp::IGNORE);
+        }
+
+        /** Sends the socket's whole output ring with one sendmsg, unless a send is in flight already: its completion requeues the rest. */
+        auto queueUringSend(TCPSocket *socket) noexcept -> void
+        {
+            auto &connection = uring_connections_[socket->pool_index_];
+            if (connection.send_in_flight_ || socket->send_closed_ || !socket->pendingSend())
+                return;
+
+            connection.send_msg_ = {};
+            connection.send_msg_.msg_iov = connection.send_iov_;
+            connection.send_msg_.msg_iovlen = socket->pendingIovecs(connection.send_iov_);
+
+            const auto sqe = uring_->getSqe();
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = static_cast<int>(socket->pool_index_);
+            sqe->flags = IOSQE_FIXED_FILE;
+            sqe->addr = reinterpret_cast<uint64_t>(&connection.send_msg_);
+            sqe->msg_flags = MSG_NOSIGNAL;
+            sqe->user_data = uringUserData(TCPUringOp::SEND, socket->pool_index_, connection.generation_);
+
+            /** Blocked until the completion, so send() neither requeues the socket nor flushes it behind the ring's back. */
+            connection.send_in_flight_ = true;
+            socket->send_blocked_ = true;
+        }
+
+        auto onUringCompletion(const io_uring_cqe &cqe) noexcept -> void
+        {
+            const auto op = static_cast<TCPUringOp>(cqe.user_data >> 56);
+            const auto index = static_cast<uint32_t>(cqe.user_data);
+            const auto generation = static_cast<uint32_t>(cqe.user_data >> 32) & 0xFFFFFF;
+
+            if (op == TCPUringOp::ACCEPT)
+            {
+                onUringAccept(cqe);
+                return;
+            }
+            if (op == TCPUringOp::IGNORE)
+                return;
+
+            const auto socket = sockets_[index];
+            if (UNLIKELY(generation != (uring_connections_[index].generation_ & 0xFFFFFF)))
+            {
+                /** Completion of a connection closed since, e.g. cancelled. Only its buffer needs handing back. */
+                if (cqe.flags & IORING_CQE_F_BUFFER)
+                    uring_buffers_->recycle(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+                return;
+            }
+
+            if (op == TCPUringOp::RECV)
+                onUringRecv(socket, cqe);
+            else
+                onUringSend(socket, cqe);
+        }
+
+        auto onUringAccept(const io_uring_cqe &cqe) noexcept -> void
+        {
+            if (!(cqe.flags & IORING_CQE_F_MORE))
+                armUringAccept();
+
+            if (cqe.res < 0)
+            {
+                logger_.log("%:% %() % accept failed. error:%\n",
+                    __FILE__, __LINE__, __func__,
+                    getCurrentTimeStr(&time_str_),
+                    std::strerror(-cqe.res));
+                return;
+            }
+
+            if (const auto socket = acceptConnection(cqe.res))
+                openUringConnection(socket);
+        }
+
+        auto onUringRecv(TCPSocket *socket, const io_uring_cqe &cqe) noexcept -> void
+        {
+            if (cqe.res > 0)
+            {
+                const auto bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                const auto len = static_cast<size_t>(cqe.res);
+                const auto taken = socket->deliver(uring_buffers_->buffer(bid), len, getCurrentNanos());
+                uring_buffers_->recycle(bid);
+                uring_received_ = true;
+
+                if (UNLIKELY(taken < len))
                 {
-                    receive_sockets_.push_back(socket);
+                    logger_.log("%:% %() % socket: % message exceeds its % byte receive ring, disconnecting.\n",
+                        __FILE__, __LINE__, __func__,
+                        getCurrentTimeStr(&time_str_),
+                        socket->socket_fd_,
+                        socket->inbound_data_.size());
+                    disconnected_sockets_.push(socket);
+                    return;
                 }
             }
+
+            if (cqe.flags & IORING_CQE_F_MORE)
+                return;
+
+            /** The multishot recv ended: re-arm it if it only ran out of buffers or stopped, close on EOF or error. */
+            if (cqe.res > 0 || cqe.res == -ENOBUFS)
+            {
+                armUringRecv(socket);
+                return;
+            }
+
+            logger_.log("%:% %() % recv socket: % ended, res: %.\n",
+                __FILE__, __LINE__, __func__,
+                getCurrentTimeStr(&time_str_),
+                socket->socket_fd_,
+                cqe.res);
+            disconnected_sockets_.push(socket);
+        }
+
+        auto onUringSend(TCPSocket *socket, const io_uring_cqe &cqe) noexcept -> void
+        {
+            uring_connections_[socket->pool_index_].send_in_flight_ = false;
+
+            logger_.log("%:% %() % send socket:% len:% pending:%\n",
+                __FILE__, __LINE__, __func__,
+                getCurrentTimeStr(&time_str_),
+                socket->socket_fd_,
+                cqe.res,
+                socket->pendingSend());
+
+            if (UNLIKELY(cqe.res < 0))
+            {
+                socket->closeOutput();
+                return;
+            }
+
+            socket->sent(static_cast<size_t>(cqe.res));
+            socket->unblockSend();
         }
 
         TCPServer() = delete;
@@ -175,16 +597,37 @@ namespace Common
         TCPServer &operator=(const TCPServer &) = delete;
         TCPServer &operator=(const TCPServer &&) = delete;
 
+        const TCPBackend backend_;
         int epoll_fd_ = -1;
         TCPSocket listener_socket_;
 
-        epoll_event events_[1024]{};
-
-        std::vector<TCPSocket *> receive_sockets_;
-        std::vector<TCPSocket *> send_sockets_;
+        epoll_event events_[TCP_MAX_EPOLL_EVENTS]{};
+        size_t num_connections_ = 0;
+
+        /** Back every pooled socket's receive and send buffers. */
+        MirroredBufferArena recv_arena_;
+        BufferArena send_arena_;
+        /** Every pooled socket, and the ones not connected right now. */
+        std::vector<TCPSocket *> sockets_;
+        std::vector<TCPSocket *> free_sockets_;
+
+        /** IO_URING backend only: the ring, its receive buffers, per connection state, and whether pollUring() read anything. */
+        std::unique_ptr<IOUring> uring_;
+        std::unique_ptr<IOUringBufferRing> uring_buffers_;
+        std::vector<TCPUringConnection> uring_connections_;
+        bool uring_received_ = false;
+        /** Written to a fixed file slot to empty it. */
+        static constexpr int TCP_URING_EMPTY_FILE = -1;
+
+        /** Sockets with data to read, with data queued by send() and room to send it, and whose peer hung up. */
+        TCPReadyList receive_sockets_{TCPReadyKind::RECV};
+        TCPReadyList send_sockets_{TCPReadyKind::SEND};
+        TCPReadyList disconnected_sockets_{TCPReadyKind::DISCONNECTED};
 
         std::function<void(TCPSocket *s, Nanos rx_time)> recv_callback_ = nullptr;
         std::function<void()> recv_finished_callback_ = nullptr;
+        /** Called with a socket whose peer hung up, right before the socket is closed and returned to the pool. */
+        std::function<void(TCPSocket *s)> disconnect_callback_ = nullptr;
 
         std::string time_str_;
         Logger &logger_;
@@ -3,25 +3,102 @@
 #ifndef TRADINGECOSYSTEM_TCP_SOCKET_H
 #define TRADINGECOSYSTEM_TCP_SOCKET_H
 
+#include <span>
+#include <memory>
 #include <vector>
+#include <algorithm>
 #include <cstring>
 #include <unistd.h>
 #include "logging.h"
 #include <functional>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include "buffer_arena.h"
 #include "socket_utils.h"
+#include "latency_probes.h"
 
 namespace Common
 {
     constexpr size_t TCPBufferSize = 64 * 1024 * 1024;
+    constexpr size_t TCP_MAX_PENDING_PROBES = 4096;
+
+    struct TCPSocket;
+    class TCPReadyList;
+
+    /** Which of the TCPServer's ready lists a TCPReadyLink belongs to. */
+    enum class TCPReadyKind : uint8_t
+    {
+        RECV = 0,
+        SEND = 1,
+        DISCONNECTED = 2
+    };
+    constexpr size_t TCP_NUM_READY_KINDS = 3;
+
+    /** What a flush() left the output ring in. */
+    enum class TCPSendState : uint8_t
+    {
+        /** Everything queued went out. */
+        DRAINED = 0,
+        /** The kernel send buffer filled up, the rest goes out once EPOLLOUT reports room. */
+        BLOCKED = 1,
+        /** The connection is broken or dropped as a slow consumer, its output is discarded. */
+        CLOSED = 2
+    };
+
+    /** Probe of a queued response, recorded once the ring has sent up to end_. */
+    struct TCPPendingProbe
+    {
+        uint64_t end_ = 0;
+        RequestProbe probe_;
+    };
+
+    /** A socket's membership of one ready list, unlinked when linked_ is false. */
+    struct TCPReadyLink
+    {
+        TCPSocket *prev_ = nullptr;
+        TCPSocket *next_ = nullptr;
+        bool linked_ = false;
+    };
 
     struct TCPSocket
     {
-        explicit TCPSocket(Logger &logger) : logger_(logger)
+        /** Standalone socket, e.g. a client connection, owning buffer_size bytes each way (inbound rounded up to pages). */
+        explicit TCPSocket(Logger &logger, const size_t buffer_size = TCPBufferSize) :
+            owned_inbound_(buffer_size ? std::make_unique<MirroredBufferArena>(1, buffer_size) : nullptr), logger_(logger)
         {
-            outbound_data_.resize(TCPBufferSize);
-            inbound_data_.resize(TCPBufferSize);
+            owned_outbound_.resize(buffer_size);
+            if (owned_inbound_)
+                inbound_data_ = owned_inbound_ -> carve();
+            outbound_data_ = {owned_outbound_.data(), buffer_size};
+            send_high_water_mark_ = buffer_size;
+            if constexpr (LATENCY_PROBES_ENABLED)
+                pending_probes_.reserve(TCP_MAX_PENDING_PROBES);
+        }
+
+        /**
+         * Socket working in buffers it does not own, e.g. carved by a TCPServer from its arenas. inbound_data must be
+         * followed by its mirror, as carved from a MirroredBufferArena.
+         */
+        TCPSocket(Logger &logger, const std::span<char> inbound_data, const std::span<char> outbound_data) :
+            outbound_data_(outbound_data), send_high_water_mark_(outbound_data.size()), inbound_data_(inbound_data),
+            logger_(logger)
+        {
+            if constexpr (LATENCY_PROBES_ENABLED)
+                pending_probes_.reserve(TCP_MAX_PENDING_PROBES);
+        }
+
+        /** Readies a pooled socket for a newly accepted connection on fd. */
+        auto reset(const int fd) noexcept -> void
+        {
+            socket_fd_ = fd;
+            send_begin_ = 0;
+            send_end_ = 0;
+            send_blocked_ = false;
+            send_closed_ = false;
+            rcv_begin_ = 0;
+            rcv_end_ = 0;
+            pending_probes_.clear();
+            next_sent_probe_ = 0;
         }
 
         auto connect(const std::string &ip, const std::string &iface, const int port, const bool is_listening) -> int
@@ -38,12 +115,21 @@ namespace Common
         }
 
         auto sendAndRecv() noexcept -> bool
+        {
+            const auto read_size = receive();
+            flush();
+            return read_size > 0;
+        }
+
+        /** One recvmsg() into the inbound buffer, calling recv_callback_ if it read anything. Returns what recvmsg() did. */
+        auto receive() noexcept -> ssize_t
         {
             char ctrl[CMSG_SPACE(sizeof(timeval))] {};
 
             iovec iov {};
-            iov.iov_base = inbound_data_.data() + next_rcv_valid_index_;
-            iov.iov_len  = TCPBufferSize - next_rcv_valid_index_;
+            /** Free space of the receive ring is contiguous thanks to the mirror, even when it wraps. */
+            iov.iov_base = inbound_data_.data() + rcv_end_ % inbound_data_.size();
+            iov.iov_len  = inbound_data_.size() - pendingRecv();
 
             msghdr msg {};
             msg.msg_name       = &socket_attrib_;
@@ -57,7 +143,7 @@ namespace Common
 
             if (read_size > 0)
             {
-                next_rcv_valid_index_ += read_size;
+                rcv_end_ += read_size;
 
                 Nanos kernel_time = 0;
                 timeval time_kernel {};
@@ -87,7 +173,7 @@ namespace Common
                     __func__,
                     getCurrentTimeStr(&time_str_),
                     socket_fd_,
-                    next_rcv_valid_index_,
+                    pendingRecv(),
                     user_time,
                     kernel_time,
                     user_time - kernel_time);
@@ -95,32 +181,171 @@ namespace Common
                 if (recv_callback_)
                     recv_callback_(this, kernel_time);
             }
+            return read_size;
+        }
+
+        /**
+         * Writes as much of the output ring as the kernel takes, both halves of a wrapped ring in one sendmsg().
+         * A short write means the kernel send buffer is full: the socket is then blocked, and send() stops asking
+         * to be flushed, until EPOLLOUT reports room again. Bytes not taken stay queued, nothing is dropped.
+         */
+        auto flush() noexcept -> TCPSendState
+        {
+            if (UNLIKELY(send_closed_))
+                return TCPSendState::CLOSED;
 
-            if (next_send_valid_index_ > 0)
+            while (pendingSend() > 0)
             {
-                const auto n = ::send(socket_fd_,
-                                      outbound_data_.data(),
-                                      next_send_valid_index_,
-                                      MSG_DONTWAIT | MSG_NOSIGNAL);
+                const auto pending = pendingSend();
+
+                iovec iov[2] {};
+                msghdr msg {};
+                msg.msg_iov    = iov;
+                msg.msg_iovlen = pendingIovecs(iov);
 
-                logger_.log("%:% %() % send socket:% len:%\n",
+                const auto n = sendmsg(socket_fd_, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+                logger_.log("%:% %() % send socket:% len:% pending:%\n",
                     __FILE__,
                     __LINE__,
                     __func__,
                     getCurrentTimeStr(&time_str_),
                     socket_fd_,
-                    n);
+                    n,
+                    pending);
+
+                if (n > 0)
+                {
+                    sent(n);
+                    if (static_cast<size_t>(n) < pending)
+                    {
+                        send_blocked_ = true;
+                        return TCPSendState::BLOCKED;
+                    }
+                    continue;
+                }
+
+                if (n < 0 && errno == EINTR)
+                    continue;
+
+                if (n < 0 && (wouldBlock() || errno == EAGAIN))
+                {
+                    send_blocked_ = true;
+                    return TCPSendState::BLOCKED;
+                }
+
+                logger_.log("%:% %() % send socket:% failed, closing its output. error:%\n",
+                    __FILE__, __LINE__, __func__,
+                    getCurrentTimeStr(&time_str_),
+                    socket_fd_,
+                    std::strerror(errno));
+                closeOutput();
+                return TCPSendState::CLOSED;
             }
+            return TCPSendState::DRAINED;
+        }
 
-            next_send_valid_index_ = 0;
+        /** The queued output as up to two iovecs, the end of the ring then its wrapped start. Returns how many are used. */
+        auto pendingIovecs(iovec (&iov)[2]) const noexcept -> size_t
+        {
+            const auto capacity = outbound_data_.size();
+            const auto begin = static_cast<size_t>(send_begin_ % capacity);
+            const auto pending = pendingSend();
+            const auto first = std::min(pending, capacity - begin);
+
+            iov[0].iov_base = outbound_data_.data() + begin;
+            iov[0].iov_len  = first;
+            iov[1].iov_base = outbound_data_.data();
+            iov[1].iov_len  = pending - first;
+            return first < pending ? 2 : 1;
+        }
 
-            return read_size > 0;
+        /** Drops the first len queued bytes once the kernel has taken them, recording the probes of every response sent in full. */
+        auto sent(const size_t len) noexcept -> void
+        {
+            send_begin_ += len;
+            if constexpr (LATENCY_PROBES_ENABLED)
+                recordSentProbes();
         }
 
-        auto send(const void *data, const size_t len) noexcept -> void
+        /**
+         * Appends len bytes read outside the socket, e.g. into an io_uring provided buffer, to the receive ring and calls
+         * recv_callback_, as many times as it takes the callback to make room for them all. Returns the bytes taken,
+         * short of len only if the callback leaves a full ring untouched, i.e. a message larger than the ring.
+         */
+        auto deliver(const char *data, const size_t len, const Nanos rx_time) noexcept -> size_t
         {
-            memcpy(outbound_data_.data() + next_send_valid_index_, data, len);
-            next_send_valid_index_ += len;
+            size_t taken = 0;
+            while (taken < len)
+            {
+                const auto room = inbound_data_.size() - pendingRecv();
+                if (UNLIKELY(!room))
+                    break;
+                const auto n = std::min(room, len - taken);
+                memcpy(inbound_data_.data() + rcv_end_ % inbound_data_.size(), data + taken, n);
+                rcv_end_ += n;
+                taken += n;
+
+                logger_.log("%:% %() % read socket: %, len: %, rx: %.\n",
+                    __FILE__, __LINE__, __func__,
+                    getCurrentTimeStr(&time_str_),
+                    socket_fd_,
+                    pendingRecv(),
+                    rx_time);
+
+                if (recv_callback_)
+                    recv_callback_(this, rx_time);
+            }
+            return taken;
+        }
+
+        /** EPOLLOUT, or an io_uring send completed: the kernel has room again, resume flushing whatever is still queued. */
+        auto unblockSend() noexcept -> void;
+
+        /** Everything received and not consumed yet, contiguous however the ring wraps. */
+        [[nodiscard]]
+        auto received() const noexcept -> std::span<const char>
+        {
+            return {inbound_data_.data() + rcv_begin_ % inbound_data_.size(), pendingRecv()};
+        }
+
+        /** Drops the first len bytes of received(), no data is moved. */
+        auto consume(const size_t len) noexcept -> void { rcv_begin_ += len; }
+
+        [[nodiscard]]
+        auto pendingRecv() const noexcept -> size_t { return static_cast<size_t>(rcv_end_ - rcv_begin_); }
+
+        [[nodiscard]]
+        auto pendingSend() const noexcept -> size_t { return static_cast<size_t>(send_end_ - send_begin_); }
+
+        /**
+         * Queues len bytes for the next flush, entering the owning server's send list if there is one. Returns false,
+         * queueing nothing, once the output is closed: a peer holding more than send_high_water_mark_ bytes unread
+         * is a slow consumer and gets disconnected rather than stalling or silently losing part of its stream.
+         */
+        auto send(const void *data, const size_t len) noexcept -> bool;
+
+        /** Probe of a response queued with send(), its last stages are recorded when its last byte goes out. */
+        auto addProbe(const RequestProbe &probe) noexcept -> void
+        {
+            if (LIKELY(pending_probes_.size() < TCP_MAX_PENDING_PROBES))
+                pending_probes_.push_back({send_end_, probe});
+        }
+
+        /** Stops all further output and hands the socket to the owning server's disconnect list to be closed. */
+        auto closeOutput() noexcept -> void;
+
+        /** Records the probes of every response whose last byte has gone out. */
+        auto recordSentProbes() noexcept -> void
+        {
+            const auto send_ticks = TSCClock::ticks();
+            while (next_sent_probe_ < pending_probes_.size() && pending_probes_[next_sent_probe_].end_ <= send_begin_)
+                LatencyProbes::instance().recordSent(pending_probes_[next_sent_probe_++].probe_, send_ticks);
+            if (next_sent_probe_ == pending_probes_.size())
+            {
+                pending_probes_.clear();
+                next_sent_probe_ = 0;
+            }
         }
 
         TCPSocket() = delete;
@@ -131,19 +356,160 @@ namespace Common
 
         int socket_fd_ = -1;
 
-        std::vector<char> outbound_data_;
-        size_t next_send_valid_index_ = 0;
-
-        std::vector<char> inbound_data_;
-        size_t next_rcv_valid_index_ = 0;
+        /** Output ring, send_begin_ and send_end_ count every byte ever sent / queued, wrapped on use. */
+        std::span<char> outbound_data_;
+        uint64_t send_begin_ = 0;
+        uint64_t send_end_ = 0;
+        /** Most bytes the ring may hold before the peer is dropped as a slow consumer, at most its size. */
+        size_t send_high_water_mark_ = 0;
+        /** Waiting for EPOLLOUT or an io_uring send in flight, and output shut for good until reset(). */
+        bool send_blocked_ = false;
+        bool send_closed_ = false;
+        std::vector<TCPPendingProbe> pending_probes_;
+        size_t next_sent_probe_ = 0;
+
+        /** Mirrored receive ring, rcv_begin_ and rcv_end_ count every byte ever consumed / received, wrapped on use. */
+        std::span<char> inbound_data_;
+        uint64_t rcv_begin_ = 0;
+        uint64_t rcv_end_ = 0;
+        /** Backing store of standalone sockets, empty for sockets working in borrowed buffers. */
+        std::unique_ptr<MirroredBufferArena> owned_inbound_;
+        std::vector<char> owned_outbound_;
 
         sockaddr_in socket_attrib_{};
 
+        /** Slot of the socket in the pool of the TCPServer that built it, also its io_uring fixed file index. */
+        uint32_t pool_index_ = 0;
+        /** Intrusive links into the TCPServer's ready lists, indexed by TCPReadyKind. */
+        TCPReadyLink ready_links_[TCP_NUM_READY_KINDS];
+        /** Lists the socket enters when send() queues data and when its output closes, set by the TCPServer that accepted it. */
+        TCPReadyList *send_list_ = nullptr;
+        TCPReadyList *disconnect_list_ = nullptr;
+
         std::function<void(TCPSocket *s, Nanos rx_time)> recv_callback_ = nullptr;
 
         std::string time_str_;
         Logger &logger_;
     };
+
+    /**
+     * Intrusive doubly linked list of sockets threaded through one of their TCPReadyLinks: push (idempotent),
+     * remove and pop are O(1) and never allocate. Iterating via next() stays valid while the current socket is removed.
+     */
+    class TCPReadyList final
+    {
+    public:
+        explicit TCPReadyList(const TCPReadyKind kind) : kind_(static_cast<size_t>(kind)) {}
+
+        auto push(TCPSocket *socket) noexcept -> void
+        {
+            auto &link = socket -> ready_links_[kind_];
+            if (link.linked_)
+                return;
+            link = {tail_, nullptr, true};
+            if (tail_)
+                tail_ -> ready_links_[kind_].next_ = socket;
+            else
+                head_ = socket;
+            tail_ = socket;
+            ++size_;
+        }
+
+        auto remove(TCPSocket *socket) noexcept -> void
+        {
+            auto &link = socket -> ready_links_[kind_];
+            if (!link.linked_)
+                return;
+            if (link.prev_)
+                link.prev_ -> ready_links_[kind_].next_ = link.next_;
+            else
+                head_ = link.next_;
+            if (link.next_)
+                link.next_ -> ready_links_[kind_].prev_ = link.prev_;
+            else
+                tail_ = link.prev_;
+            link = {};
+            --size_;
+        }
+
+        [[nodiscard]]
+        auto head() const noexcept -> TCPSocket* { return head_; }
+
+        [[nodiscard]]
+        auto next(const TCPSocket *socket) const noexcept -> TCPSocket* { return socket -> ready_links_[kind_].next_; }
+
+        [[nodiscard]]
+        auto size() const noexcept -> size_t { return size_; }
+
+        TCPReadyList() = delete;
+        TCPReadyList(const TCPReadyList &) = delete;
+        TCPReadyList(const TCPReadyList &&) = delete;
+        TCPReadyList &operator=(const TCPReadyList &) = delete;
+        TCPReadyList &operator=(const TCPReadyList &&) = delete;
+
+    private:
+        const size_t kind_;
+        TCPSocket *head_ = nullptr;
+        TCPSocket *tail_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    inline auto TCPSocket::send(const void *data, const size_t len) noexcept -> bool
+    {
+        if (UNLIKELY(send_closed_))
+            return false;
+
+        if (UNLIKELY(pendingSend() + len > send_high_water_mark_))
+        {
+            if (!send_blocked_)
+                flush();
+            if (pendingSend() + len > send_high_water_mark_)
+            {
+                if (!send_closed_)
+                {
+                    logger_.log("%:% %() % slow consumer socket:% pending:% len:% high water mark:%, disconnecting.\n",
+                        __FILE__, __LINE__, __func__,
+                        getCurrentTimeStr(&time_str_),
+                        socket_fd_,
+                        pendingSend(),
+                        len,
+                        send_high_water_mark_);
+                    closeOutput();
+                }
+                return false;
+            }
+        }
+
+        const auto capacity = outbound_data_.size();
+        const auto end = static_cast<size_t>(send_end_ % capacity);
+        const auto first = std::min(len, capacity - end);
+        memcpy(outbound_data_.data() + end, data, first);
+        memcpy(outbound_data_.data(), static_cast<const char *>(data) + first, len - first);
+        send_end_ += len;
+
+        if (send_list_ && !send_blocked_)
+            send_list_ -> push(this);
+        return true;
+    }
+
+    inline auto TCPSocket::unblockSend() noexcept -> void
+    {
+        send_blocked_ = false;
+        if (send_list_ && pendingSend() > 0)
+            send_list_ -> push(this);
+    }
+
+    inline auto TCPSocket::closeOutput() noexcept -> void
+    {
+        send_closed_ = true;
+        send_begin_ = send_end_;
+        pending_probes_.clear();
+        next_sent_probe_ = 0;
+        if (send_list_)
+            send_list_ -> remove(this);
+        if (disconnect_list_)
+            disconnect_list_ -> push(this);
+    }
 }
 
 #endif // TRADINGECOSYSTEM_TCP_SOCKET_H
\ No newline at end of file
@@ -5,7 +5,17 @@
 
 #include <chrono>
 #include <ctime>
+#include <atomic>
 #include <string>
+#include <thread>
+#include <cstdint>
+#include <string_view>
+#include "macros.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
 
 namespace Common
 {
@@ -17,19 +27,246 @@ namespace Common
     constexpr Nanos NANOS_TO_MILLIS  = NANOS_TO_MICROS * MICROS_TO_MILLIS;
     constexpr Nanos NANOS_TO_SECS    = NANOS_TO_MILLIS * MILLIS_TO_SECS;
 
-    inline auto getCurrentNanos() noexcept
+    inline auto clockNanos(const clockid_t clock_id) noexcept -> Nanos
     {
-        return std::chrono::duration_cast<std::chrono::nanoseconds>
-        (std::chrono::system_clock::now().time_since_epoch()).count();
+        timespec ts{};
+        clock_gettime(clock_id, &ts);
+        return ts.tv_sec * NANOS_TO_SECS + ts.tv_nsec;
     }
-    inline auto& getCurrentTimeStr(std::string* time_str)
+
+    /** Time stamp counter, waiting for every earlier instruction to execute first. */
+    inline auto rdtscp() noexcept -> uint64_t
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned aux;
+        return __rdtscp(&aux);
+#else
+        return static_cast<uint64_t>(clockNanos(CLOCK_MONOTONIC_RAW));
+#endif
+    }
+
+    /**
+     * Wall clock time derived from the invariant TSC.
+     * The tick rate is measured against CLOCK_MONOTONIC_RAW at start up. A background thread calling correct(), the
+     * LogBackend's, re-measures it every TSC_CORRECTION_INTERVAL over the whole time since then and slews the
+     * conversion towards CLOCK_REALTIME, so converted time never steps backwards. Converting ticks is one 64x64 bit
+     * multiply and a shift on parameters read through a seqlock, never a clock_gettime() on the calling thread.
+     * Without an invariant TSC ticks are CLOCK_MONOTONIC_RAW nanoseconds, converted 1:1 and slewed the same way.
+     */
+    class TSCClock final
     {
-        const auto time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-        time_str -> assign(ctime(&time));
+    public:
+        static constexpr Nanos TSC_CORRECTION_INTERVAL = NANOS_TO_SECS;
+
+        static auto instance() noexcept -> TSCClock&
+        {
+            static TSCClock clock;
+            return clock;
+        }
+
+        [[nodiscard]]
+        static auto ticks() noexcept -> uint64_t
+        {
+            return LIKELY(invariant_tsc_) ? rdtscp() : static_cast<uint64_t>(clockNanos(CLOCK_MONOTONIC_RAW));
+        }
+
+        /** Wall clock nanoseconds since the epoch at ticks. */
+        [[nodiscard]]
+        auto ticksToNanos(const uint64_t ticks) const noexcept -> Nanos
+        {
+            while (true)
+            {
+                const auto seq = seq_.load(std::memory_order_acquire);
+                const auto base_ticks = base_ticks_.load(std::memory_order_relaxed);
+                const auto base_nanos = base_nanos_.load(std::memory_order_relaxed);
+                const auto mult = mult_.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (LIKELY(!(seq & 1) && seq == seq_.load(std::memory_order_relaxed)))
+                    return base_nanos + scale(static_cast<int64_t>(ticks - base_ticks), mult);
+            }
+        }
+
+        /** Length in nanoseconds of an interval of ticks. */
+        [[nodiscard]]
+        auto tickDeltaToNanos(const uint64_t ticks) const noexcept -> Nanos
+        {
+            return scale(static_cast<int64_t>(ticks), rate_mult_.load(std::memory_order_relaxed));
+        }
+
+        [[nodiscard]]
+        auto nanos() const noexcept -> Nanos { return ticksToNanos(ticks()); }
+
+        [[nodiscard]]
+        auto ticksPerSecond() const noexcept -> double
+        {
+            return static_cast<double>(NANOS_TO_SECS) * (1ULL << MULT_SHIFT) / static_cast<double>(rate_mult_.load());
+        }
+
+        /**
+         * Re-measures the tick rate and slews the conversion once TSC_CORRECTION_INTERVAL has passed since the last
+         * time, otherwise returns after one tick read. Meant for a background thread, calling it often is cheap.
+         */
+        auto correct() noexcept -> void
+        {
+            if (ticks() < next_correction_ticks_.load(std::memory_order_relaxed))
+                return;
+            if (correcting_.test_and_set(std::memory_order_acquire))
+                return;
+            if (ticks() >= next_correction_ticks_.load(std::memory_order_relaxed))
+                recalibrate(true);
+            correcting_.clear(std::memory_order_release);
+        }
+
+        [[nodiscard]]
+        static auto isInvariant() noexcept { return invariant_tsc_; }
+
+        TSCClock(const TSCClock &) = delete;
+        TSCClock(const TSCClock &&) = delete;
+        TSCClock &operator = (const TSCClock &) = delete;
+        TSCClock &operator = (const TSCClock &&) = delete;
+
+    private:
+        static constexpr unsigned MULT_SHIFT = 32;
+        static constexpr Nanos CALIBRATION_INTERVAL = 20 * NANOS_TO_MILLIS;
+        /** Most a correction slews the conversion by over one TSC_CORRECTION_INTERVAL, 500 ppm. */
+        static constexpr Nanos MAX_SLEW = TSC_CORRECTION_INTERVAL / 2000;
+
+        /** First (tick, CLOCK_MONOTONIC_RAW) sample, the rate is always measured from here. */
+        uint64_t start_ticks_ = 0;
+        Nanos start_raw_nanos_ = 0;
+
+        alignas(64) std::atomic<uint64_t> seq_ = {0};
+        std::atomic<uint64_t> base_ticks_ = {0};
+        std::atomic<Nanos> base_nanos_ = {0};
+        /** Slope of the conversion, the measured rate plus the slew towards CLOCK_REALTIME. */
+        std::atomic<uint64_t> mult_ = {1ULL << MULT_SHIFT};
+        /** Measured nanoseconds per tick, for intervals. */
+        std::atomic<uint64_t> rate_mult_ = {1ULL << MULT_SHIFT};
+        std::atomic<uint64_t> next_correction_ticks_ = {UINT64_MAX};
+        std::atomic_flag correcting_ = ATOMIC_FLAG_INIT;
+
+        TSCClock() noexcept
+        {
+            sample(&start_ticks_, &start_raw_nanos_);
+            if (invariant_tsc_)
+                std::this_thread::sleep_for(std::chrono::nanoseconds(CALIBRATION_INTERVAL));
+            recalibrate(false);
+        }
 
-        if (!time_str -> empty())
-            time_str -> at(time_str -> length() - 1) = '\0';
+        static auto scale(const int64_t ticks, const uint64_t mult) noexcept -> Nanos
+        {
+            return static_cast<Nanos>((static_cast<__int128>(ticks) * mult) >> MULT_SHIFT);
+        }
+
+        static auto hasInvariantTSC() noexcept -> bool
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+            if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+                return false;
+            return edx & (1U << 8);
+#else
+            return false;
+#endif
+        }
+
+        static inline const bool invariant_tsc_ = hasInvariantTSC();
+
+        /** A tick count and CLOCK_MONOTONIC_RAW read as close together as possible. */
+        static auto sample(uint64_t *ticks, Nanos *raw_nanos) noexcept -> void
+        {
+            Nanos best_window = INT64_MAX;
+            for (int i = 0; i < 5; ++i)
+            {
+                const auto before = clockNanos(CLOCK_MONOTONIC_RAW);
+                const auto tsc = TSCClock::ticks();
+                const auto after = clockNanos(CLOCK_MONOTONIC_RAW);
+                if (after - before < best_window)
+                {
+                    best_window = after - before;
+                    *ticks = tsc;
+                    *raw_nanos = before + (after - before) / 2;
+                }
+            }
+        }
+
+        /**
+         * Measures the rate over the whole time since start up. When slewing, the conversion stays continuous at
+         * now and its slope absorbs the gap to CLOCK_REALTIME over the next interval, at most MAX_SLEW of it when
+         * the conversion runs ahead. A conversion behind by more than MAX_SLEW steps forward, never backwards.
+         */
+        auto recalibrate(const bool slew) noexcept -> void
+        {
+            uint64_t now_ticks = 0;
+            Nanos now_raw_nanos = 0;
+            sample(&now_ticks, &now_raw_nanos);
+            const auto realtime_offset = clockNanos(CLOCK_REALTIME) - clockNanos(CLOCK_MONOTONIC_RAW);
+
+            const auto elapsed_ticks = now_ticks - start_ticks_;
+            const auto elapsed_nanos = static_cast<unsigned __int128>(now_raw_nanos - start_raw_nanos_);
+            /** Without an invariant TSC ticks already are nanoseconds and the rate stays at 1:1. */
+            const auto rate = invariant_tsc_ && elapsed_ticks ? static_cast<uint64_t>((elapsed_nanos << MULT_SHIFT) / elapsed_ticks)
+                                                              : rate_mult_.load(std::memory_order_relaxed);
+
+            auto base_nanos = now_raw_nanos + realtime_offset;
+            auto mult = rate;
+            if (slew)
+            {
+                const auto current_nanos = ticksToNanos(now_ticks);
+                const auto error = base_nanos - current_nanos;
+                if (error <= MAX_SLEW)
+                {
+                    base_nanos = current_nanos;
+                    mult = static_cast<uint64_t>(static_cast<__int128>(rate) * (TSC_CORRECTION_INTERVAL + std::max(error, -MAX_SLEW))
+                        / TSC_CORRECTION_INTERVAL);
+                }
+            }
+
+            const auto seq = seq_.load(std::memory_order_relaxed);
+            seq_.store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            base_ticks_.store(now_ticks, std::memory_order_relaxed);
+            base_nanos_.store(base_nanos, std::memory_order_relaxed);
+            mult_.store(mult, std::memory_order_relaxed);
+            seq_.store(seq + 2, std::memory_order_release);
+            rate_mult_.store(rate, std::memory_order_relaxed);
+
+            next_correction_ticks_.store(now_ticks + static_cast<uint64_t>(
+                static_cast<double>(TSC_CORRECTION_INTERVAL) * ((1ULL << MULT_SHIFT) / static_cast<double>(rate))),
+                std::memory_order_relaxed);
+        }
+    };
+
+    inline auto getCurrentNanos() noexcept -> Nanos
+    {
+        return TSCClock::instance().nanos();
+    }
+
+    /**
+     * "Www Mmm dd hh:mm:ss yyyy" for the current second, formatted at most once per second per thread.
+     * The view stays valid and is updated in place, on the calling thread, by later calls.
+     */
+    inline auto getCachedTimeStr() noexcept -> std::string_view
+    {
+        static thread_local char time_str[32] = {};
+        static thread_local size_t length = 0;
+        static thread_local Nanos next_second = 0;
+
+        if (const auto now = getCurrentNanos(); now >= next_second)
+        {
+            const time_t time = now / NANOS_TO_SECS;
+            ctime_r(&time, time_str);
+            length = std::string_view(time_str).find('\n');
+            next_second = (time + 1) * NANOS_TO_SECS;
+        }
+        return {time_str, length};
+    }
+
+    inline auto& getCurrentTimeStr(std::string* time_str)
+    {
+        const auto cached = getCachedTimeStr();
+        time_str -> assign(cached.data(), cached.size());
         return *time_str;
     }
 }
-#endif //TRADINGECOSYSTEM_TIME_UTILS_H
\ No newline at end of file
+#endif //TRADINGECOSYSTEM_TIME_UTILS_H
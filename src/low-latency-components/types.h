@@ -86,12 +86,28 @@ namespace Common {
         return "UNKNOWN";
     }
 
+    /** Maps BUY / SELL to 0 / 1 for per-side arrays. */
+    constexpr auto sideToIndex(const Side side) noexcept {
+        return static_cast<size_t>(side == Side::SELL);
+    }
+
     constexpr size_t ME_MAX_TICKERS = 8;
     constexpr size_t ME_MAX_NUM_CLIENTS = 256;
-    constexpr size_t ME_MAX_PRICE_LEVELS = 256;
+    constexpr size_t ME_MAX_PRICE_LEVELS = 64 * 1024;
     constexpr size_t ME_MAX_ORDER_IDS = 1024 * 1024;
+    /** Resting orders one book holds, a NEW whose remainder would rest past it is canceled instead. */
+    constexpr size_t ME_MAX_LIVE_ORDERS_PER_TICKER = ME_MAX_ORDER_IDS / ME_MAX_TICKERS;
+    /** Resting orders across every book, the most a market data snapshot image holds. */
+    constexpr size_t ME_MAX_LIVE_ORDERS = ME_MAX_TICKERS * ME_MAX_LIVE_ORDERS_PER_TICKER;
+    /** Live orders a book's client order map is sized for up front, it grows past that on demand. */
+    constexpr size_t ME_EXPECTED_LIVE_ORDERS = 64 * 1024;
     constexpr size_t ME_MAX_CLIENT_UPDATES = 256 * 1024;
     constexpr size_t ME_MAX_MARKET_UPDATES = 256 * 1024;
 
+    /** Matching engine shard that owns the book of ticker_id when the tickers are split over num_shards engines. */
+    constexpr auto tickerIdToShard(const TickerId ticker_id, const size_t num_shards) noexcept -> size_t {
+        return ticker_id % num_shards;
+    }
+
 }
 #endif //TRADINGECOSYSTEM_TYPES_H
\ No newline at end of file
@@ -3,14 +3,21 @@
 #include "low-latency-components/lock_free_queue.h"
 #include "low-latency-components/logging.h"
 #include "low-latency-components/tcp_server.h"
-#include "exchange/matcher/matching_engine.h"
+#include "low-latency-components/latency_probes.h"
+#include "exchange/matcher/sharded_matching_engine.h"
+#include "exchange/order_server/order_server.h"
+#include "exchange/journal/request_journal.h"
+#include "exchange/market_data/market_data_publisher.h"
 #include <csignal>
 
 using namespace Common;
 using namespace std::literals::chrono_literals;
 
 Logger* logger = nullptr;
-Exchange::MatchingEngine* matching_engine = nullptr;
+Exchange::ShardedMatchingEngine* matching_engine = nullptr;
+Exchange::OrderServer* order_server = nullptr;
+Exchange::RequestJournal* request_journal = nullptr;
+Exchange::MarketDataPublisher* market_data_publisher = nullptr;
 
 /** test threads */
 auto dummyFunction(const int a, const int b, const bool sleep)
@@ -58,6 +65,15 @@ void signal_handler(int) {
     delete logger;
     logger = nullptr;
 
+    delete order_server;
+    order_server = nullptr;
+
+    delete market_data_publisher;
+    market_data_publisher = nullptr;
+
+    delete request_journal;
+    request_journal = nullptr;
+
     delete matching_engine;
     matching_engine = nullptr;
 
@@ -65,7 +81,7 @@ void signal_handler(int) {
     exit(EXIT_SUCCESS);
 }
 
-int main(int, char **)
+int main(int argc, char **argv)
 {
     // const auto t1 = createAndStartThread(-1, "dummyFunction1", dummyFunction, 10, 30, false);
     // const auto t2 = createAndStartThread( 1, "dummyFunction2", dummyFunction, 20, 51, true );
@@ -210,21 +226,88 @@ int main(int, char **)
     //     std::this_thread::sleep_for(500ms);
     // }
 
-    logger = new Logger("exchange_main.log");
+    logger = new Logger("exchange_main.log", 16 * 1024);
     std::signal(SIGINT, signal_handler);
 
+    if constexpr (LATENCY_PROBES_ENABLED)
+        LatencyProbes::instance().startReporting("exchange_latency.log", NANOS_TO_SECS);
+
     constexpr int sleep_time = 100 * 1000;
 
-    Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
-    Exchange::MEClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
-    Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_CLIENT_UPDATES);
+    /**
+     * usage: TradingEcosystem [-j <journal prefix>] [-u] [engine core id]...
+     * One matching engine shard per core id, a single unpinned one by default. -u runs the order gateway on io_uring.
+     */
+    std::string journal_prefix = "exchange_journal";
+    std::vector<int> engine_core_ids;
+    TCPServerCfg order_gw_cfg;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string_view(argv[i]) == "-j" && i + 1 < argc) {
+            journal_prefix = argv[++i];
+            continue;
+        }
+        if (std::string_view(argv[i]) == "-u") {
+            order_gw_cfg.backend_ = TCPBackend::IO_URING;
+            continue;
+        }
+        engine_core_ids.push_back(std::stoi(argv[i]));
+    }
+    if (engine_core_ids.empty())
+        engine_core_ids.push_back(-1);
 
     std::string time_str;
-    logger -> log("%:% %() % Starting Matching Engine ... \n",
+    logger -> log("%:% %() % Starting Matching Engine with % shard(s) ... \n",
+        __FILE__, __LINE__, __func__,
+        getCurrentTimeStr(&time_str),
+        engine_core_ids.size());
+    matching_engine = new Exchange::ShardedMatchingEngine(engine_core_ids);
+
+    const std::string mkt_pub_iface = "lo";
+    const std::string pub_incremental_ip = "233.252.14.3";
+    constexpr int pub_incremental_port = 20001;
+    const std::string pub_snapshot_ip = "233.252.14.1";
+    constexpr int pub_snapshot_port = 20000;
+
+    logger -> log("%:% %() % Creating Market Data Publisher ... \n",
         __FILE__, __LINE__, __func__,
         getCurrentTimeStr(&time_str));
-    matching_engine = new Exchange::MatchingEngine(&client_requests, &client_responses, &market_updates);
+    market_data_publisher = new Exchange::MarketDataPublisher(matching_engine -> marketUpdateQueues(),
+        mkt_pub_iface, pub_incremental_ip, pub_incremental_port, pub_snapshot_ip, pub_snapshot_port);
+
+    /** Rebuild the books and the market data snapshot from the journal before anything new is sequenced. */
+    const auto replay_start = getCurrentNanos();
+    const auto num_replayed = Exchange::RequestJournal::replay(journal_prefix, [&time_str](const Exchange::JournalRecord &record) {
+        const auto replayed = matching_engine -> replayRequest(record.request_, [](const Exchange::MEMarketUpdate &market_update) {
+            market_data_publisher -> replayMarketUpdate(market_update);
+        });
+        if (!replayed)
+            logger -> log("%:% %() % Skipped invalid journaled request seq: % %. \n",
+                __FILE__, __LINE__, __func__,
+                getCurrentTimeStr(&time_str),
+                record.seq_num_,
+                record.request_.toString());
+    });
+    logger -> log("%:% %() % Replayed % journaled requests from % in % ms. \n",
+        __FILE__, __LINE__, __func__,
+        getCurrentTimeStr(&time_str),
+        num_replayed,
+        journal_prefix,
+        (getCurrentNanos() - replay_start) / NANOS_TO_MILLIS);
+
+    request_journal = new Exchange::RequestJournal(journal_prefix);
+    request_journal -> start();
     matching_engine -> start();
+    market_data_publisher -> start();
+
+    const std::string order_gw_iface = "lo";
+    constexpr int order_gw_port = 12345;
+
+    logger -> log("%:% %() % Starting Order Server ... \n",
+        __FILE__, __LINE__, __func__,
+        getCurrentTimeStr(&time_str));
+    order_server = new Exchange::OrderServer(matching_engine -> clientRequestQueues(),
+        matching_engine -> clientResponseQueues(), order_gw_iface, order_gw_port, request_journal, order_gw_cfg);
+    order_server -> start();
 
     while (true){
         logger -> log("%:% %() % Sleeping for a few milliseconds ...\n",
@@ -0,0 +1,195 @@
+#include "market_data_consumer.h"
+#include "low-latency-components/thread_utils.h"
+
+namespace Trading {
+    using namespace Exchange;
+
+    static_assert((MDC_MAX_QUEUED_INC_UPDATES & (MDC_MAX_QUEUED_INC_UPDATES - 1)) == 0,
+        "MDC_MAX_QUEUED_INC_UPDATES must be a power of two.");
+
+    MarketDataConsumer::MarketDataConsumer(
+        MEMarketUpdateLFQueue *market_updates,
+        const std::string &iface,
+        const std::string &snapshot_ip,
+        const int snapshot_port,
+        const std::string &incremental_ip,
+        const int incremental_port,
+        const int core_id,
+        const bool use_io_uring) :
+        incoming_md_updates_(market_updates),
+        core_id_(core_id),
+        logger_("trading_market_data_consumer.log"),
+        incremental_mcast_socket_(logger_, {.num_slots_ = MDC_MAX_BATCH_DATAGRAMS, .kernel_buffer_size_ = MDC_SOCKET_RCVBUF_SIZE,
+            .io_uring_ = use_io_uring}),
+        snapshot_mcast_socket_(logger_, {.num_slots_ = MDC_MAX_BATCH_DATAGRAMS, .kernel_buffer_size_ = MDC_SOCKET_RCVBUF_SIZE,
+            .io_uring_ = use_io_uring}),
+        iface_(iface),
+        snapshot_ip_(snapshot_ip),
+        snapshot_port_(snapshot_port),
+        queued_inc_updates_(MDC_MAX_QUEUED_INC_UPDATES),
+        snapshot_updates_(MDC_MAX_SNAPSHOT_UPDATES)
+        {
+            const auto recv_callback = [this](auto socket, auto datagrams) { recvCallback(socket, datagrams); };
+            incremental_mcast_socket_.recv_datagrams_callback_ = recv_callback;
+            snapshot_mcast_socket_.recv_datagrams_callback_ = recv_callback;
+
+            ASSERT(incremental_mcast_socket_.init(incremental_ip, iface, incremental_port, true) >= 0,
+                "Unable to create incremental mcast socket. error:" + std::string(std::strerror(errno)));
+            ASSERT(incremental_mcast_socket_.join(incremental_ip),
+                "Join failed on:" + std::to_string(incremental_mcast_socket_.socket_fd_) + " error:" + std::string(std::strerror(errno)));
+        }
+
+    MarketDataConsumer::~MarketDataConsumer() {
+        stop();
+
+        using namespace std::literals::chrono_literals;
+        std::this_thread::sleep_for(1s);
+    }
+
+    auto MarketDataConsumer::start() -> void {
+        run_ = true;
+        ASSERT(createAndStartThread(core_id_, "Trading/MarketDataConsumer", [this] { run(); }) != nullptr,
+            "Failed to start MarketDataConsumer thread.");
+    }
+
+    auto MarketDataConsumer::stop() -> void {
+        run_ = false;
+    }
+
+    auto MarketDataConsumer::run() noexcept -> void {
+        logger_.log("%:% %() %\n",
+            __FILE__, __LINE__, __func__,
+            getCurrentTimeStr(&time_str_));
+
+        while (run_) {
+            incremental_mcast_socket_.sendAndRecv();
+            if (in_recovery_)
+                snapshot_mcast_socket_.sendAndRecv();
+        }
+    }
+
+    /** Every datagram carries whole MDPMarketUpdates. */
+    auto MarketDataConsumer::recvCallback(McastSocket *socket, const std::span<const McastDatagram> datagrams) noexcept -> void {
+        const auto is_snapshot = socket == &snapshot_mcast_socket_;
+        for (const auto &datagram : datagrams) {
+            const auto updates = reinterpret_cast<const MDPMarketUpdate *>(datagram.data_);
+            const auto num_updates = datagram.len_ / sizeof(MDPMarketUpdate);
+            for (size_t i = 0; i < num_updates; ++i) {
+                if (is_snapshot)
+                    onSnapshotUpdate(updates[i]);
+                else
+                    onIncrementalUpdate(updates[i]);
+            }
+        }
+    }
+
+    auto MarketDataConsumer::onIncrementalUpdate(const MDPMarketUpdate &market_update) noexcept -> void {
+        if (LIKELY(!in_recovery_)) {
+            if (LIKELY(market_update.seq_num_ == next_exp_inc_seq_num_)) {
+                deliver(market_update.me_market_update_);
+                ++next_exp_inc_seq_num_;
+                return;
+            }
+            /** Duplicates and stale datagrams. */
+            if (market_update.seq_num_ < next_exp_inc_seq_num_)
+                return;
+
+            startRecovery(market_update.seq_num_);
+        }
+        queueIncremental(market_update);
+    }
+
+    /**
+     * Collects one snapshot cycle at a time, starting at a SNAPSHOT_START with seq_num_ 0 and giving up on the
+     * cycle at the first missing message.
+     */
+    auto MarketDataConsumer::onSnapshotUpdate(const MDPMarketUpdate &market_update) noexcept -> void {
+        const auto &me_market_update = market_update.me_market_update_;
+
+        if (me_market_update.type_ == MEMarketUpdateType::SNAPSHOT_START) {
+            in_snapshot_cycle_ = market_update.seq_num_ == 0;
+            next_exp_snapshot_seq_num_ = 1;
+            num_snapshot_updates_ = 0;
+            snapshot_inc_seq_num_ = me_market_update.order_id_;
+            return;
+        }
+        if (!in_snapshot_cycle_)
+            return;
+
+        if (UNLIKELY(market_update.seq_num_ != next_exp_snapshot_seq_num_)) {
+            logger_.log("%:% %() % Dropping snapshot cycle, expected seq: % received: %.\n",
+                __FILE__, __LINE__, __func__,
+                getCurrentTimeStr(&time_str_),
+                next_exp_snapshot_seq_num_,
+                market_update.seq_num_);
+            in_snapshot_cycle_ = false;
+            return;
+        }
+        ++next_exp_snapshot_seq_num_;
+
+        if (me_market_update.type_ == MEMarketUpdateType::SNAPSHOT_END) {
+            in_snapshot_cycle_ = false;
+            if (LIKELY(me_market_update.order_id_ == snapshot_inc_seq_num_))
+                tryFinishRecovery(snapshot_inc_seq_num_);
+            return;
+        }
+
+        if (UNLIKELY(num_snapshot_updates_ == snapshot_updates_.size())) {
+            FATAL("Snapshot cycle larger than " + std::to_string(snapshot_updates_.size()) + " updates.");
+        }
+        snapshot_updates_[num_snapshot_updates_++] = me_market_update;
+    }
+
+    auto MarketDataConsumer::startRecovery(const size_t received_seq_num) noexcept -> void {
+        logger_.log("%:% %() % Gap on incremental stream, expected seq: % received: %. Joining snapshot stream.\n",
+            __FILE__, __LINE__, __func__,
+            getCurrentTimeStr(&time_str_),
+            next_exp_inc_seq_num_,
+            received_seq_num);
+
+        in_recovery_ = true;
+        in_snapshot_cycle_ = false;
+        highest_queued_inc_seq_num_ = 0;
+
+        ASSERT(snapshot_mcast_socket_.init(snapshot_ip_, iface_, snapshot_port_, true) >= 0,
+            "Unable to create snapshot mcast socket. error:" + std::string(std::strerror(errno)));
+        ASSERT(snapshot_mcast_socket_.join(snapshot_ip_),
+            "Join failed on:" + std::to_string(snapshot_mcast_socket_.socket_fd_) + " error:" + std::string(std::strerror(errno)));
+    }
+
+    /**
+     * Resynchronises if every incremental after the snapshot's last_inc_seq_num, up to the highest one queued,
+     * is in the ring. A slot holds seq_num_ s only if s itself was queued, so no slot needs clearing.
+     */
+    auto MarketDataConsumer::tryFinishRecovery(const size_t last_inc_seq_num) noexcept -> void {
+        const auto mask = queued_inc_updates_.size() - 1;
+        for (auto seq_num = last_inc_seq_num + 1; seq_num <= highest_queued_inc_seq_num_; ++seq_num) {
+            if (queued_inc_updates_[seq_num & mask].seq_num_ != seq_num) {
+                logger_.log("%:% %() % Snapshot up to inc seq: % not bridged, missing inc seq: % of %. Waiting for the next one.\n",
+                    __FILE__, __LINE__, __func__,
+                    getCurrentTimeStr(&time_str_),
+                    last_inc_seq_num,
+                    seq_num,
+                    highest_queued_inc_seq_num_);
+                return;
+            }
+        }
+
+        for (size_t i = 0; i < num_snapshot_updates_; ++i)
+            deliver(snapshot_updates_[i]);
+        for (auto seq_num = last_inc_seq_num + 1; seq_num <= highest_queued_inc_seq_num_; ++seq_num)
+            deliver(queued_inc_updates_[seq_num & mask].me_market_update_);
+
+        next_exp_inc_seq_num_ = std::max(last_inc_seq_num, highest_queued_inc_seq_num_) + 1;
+        in_recovery_ = false;
+        num_recoveries_ = num_recoveries_ + 1;
+        snapshot_mcast_socket_.leave(snapshot_ip_, snapshot_port_);
+
+        logger_.log("%:% %() % Recovered from snapshot of % updates up to inc seq: %, resuming at inc seq: %.\n",
+            __FILE__, __LINE__, __func__,
+            getCurrentTimeStr(&time_str_),
+            num_snapshot_updates_,
+            last_inc_seq_num,
+            next_exp_inc_seq_num_);
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#ifndef TRADINGECOSYSTEM_MARKET_DATA_CONSUMER_H
+#define TRADINGECOSYSTEM_MARKET_DATA_CONSUMER_H
+
+#include <vector>
+#include <algorithm>
+
+#include "low-latency-components/macros.h"
+#include "low-latency-components/logging.h"
+#include "low-latency-components/time_utils.h"
+#include "low-latency-components/mcast_socket.h"
+#include "exchange/market_data/market_update.h"
+
+namespace Trading {
+    /** Incremental updates kept while recovering, a gap is only recoverable from a snapshot taken inside this window. */
+    constexpr size_t MDC_MAX_QUEUED_INC_UPDATES = ME_MAX_MARKET_UPDATES;
+    /** Largest snapshot cycle: a CLEAR per ticker plus an ADD per live order across every book. */
+    constexpr size_t MDC_MAX_SNAPSHOT_UPDATES = ME_MAX_TICKERS + ME_MAX_LIVE_ORDERS;
+    /** Kernel receive buffer requested for both streams, a snapshot cycle arrives as one burst of datagrams. */
+    constexpr int MDC_SOCKET_RCVBUF_SIZE = 64 * 1024 * 1024;
+    /** Most datagrams read by one recvmmsg(), or receive buffers of each stream with io_uring. */
+    constexpr size_t MDC_MAX_BATCH_DATAGRAMS = 64;
+
+    /**
+     * Client side of the exchange market data: reads the incremental stream and hands every update, in sequence,
+     * to the application through an SPSC MEMarketUpdateLFQueue.
+     * A seq_num_ gap (or joining after the stream started) switches to recovery: the snapshot stream is joined and
+     * incrementals are queued in a ring indexed by seq_num_ while a complete snapshot cycle is collected. Once a cycle
+     * whose last incremental seq is followed by an unbroken run of queued incrementals arrives, the snapshot's
+     * CLEAR / ADD updates and then those incrementals are delivered, the snapshot stream is left and the incremental
+     * stream is followed again. Cycles with a missing message or not bridged by the queued incrementals are dropped
+     * and the next cycle is awaited. SNAPSHOT_START and SNAPSHOT_END are not delivered.
+     * All buffers are allocated up front, nothing is allocated once the consumer is running.
+     */
+    class MarketDataConsumer {
+    public:
+        MarketDataConsumer(Exchange::MEMarketUpdateLFQueue *market_updates, const std::string &iface,
+            const std::string &snapshot_ip, int snapshot_port,
+            const std::string &incremental_ip, int incremental_port, int core_id = -1, bool use_io_uring = false);
+        ~MarketDataConsumer();
+
+        auto start() -> void;
+        auto stop()  -> void;
+
+        auto run() noexcept -> void;
+
+        /** Read from other threads for monitoring only. */
+        [[nodiscard]]
+        auto inRecovery() const noexcept -> bool { return in_recovery_; }
+        [[nodiscard]]
+        auto numRecoveries() const noexcept -> size_t { return num_recoveries_; }
+        [[nodiscard]]
+        auto nextExpectedIncSeqNum() const noexcept -> size_t { return next_exp_inc_seq_num_; }
+
+        MarketDataConsumer() = delete;
+        MarketDataConsumer(const MarketDataConsumer & ) = delete;
+        MarketDataConsumer(const MarketDataConsumer &&) = delete;
+        MarketDataConsumer &operator = (const MarketDataConsumer & ) = delete;
+        MarketDataConsumer &operator = (const MarketDataConsumer &&) = delete;
+
+    private:
+        size_t next_exp_inc_seq_num_ = 1;
+        Exchange::MEMarketUpdateLFQueue *incoming_md_updates_ = nullptr;
+
+        volatile bool run_ = false;
+        const int core_id_ = -1;
+        std::string time_str_;
+        Logger logger_;
+        McastSocket incremental_mcast_socket_;
+        McastSocket snapshot_mcast_socket_;
+
+        const std::string iface_;
+        const std::string snapshot_ip_;
+        const int snapshot_port_;
+
+        volatile bool in_recovery_ = false;
+        volatile size_t num_recoveries_ = 0;
+
+        /** Incrementals received while recovering, the slot of seq_num_ s is s & (capacity - 1). */
+        std::vector<Exchange::MDPMarketUpdate> queued_inc_updates_;
+        size_t highest_queued_inc_seq_num_ = 0;
+
+        /** CLEAR / ADD updates of the snapshot cycle being collected. */
+        std::vector<Exchange::MEMarketUpdate> snapshot_updates_;
+        size_t num_snapshot_updates_ = 0;
+        bool in_snapshot_cycle_ = false;
+        size_t next_exp_snapshot_seq_num_ = 0;
+        size_t snapshot_inc_seq_num_ = 0;
+
+        auto recvCallback(McastSocket *socket, std::span<const McastDatagram> datagrams) noexcept -> void;
+        auto onIncrementalUpdate(const Exchange::MDPMarketUpdate &market_update) noexcept -> void;
+        auto onSnapshotUpdate(const Exchange::MDPMarketUpdate &market_update) noexcept -> void;
+        auto startRecovery(size_t received_seq_num) noexcept -> void;
+        auto tryFinishRecovery(size_t last_inc_seq_num) noexcept -> void;
+
+        auto queueIncremental(const Exchange::MDPMarketUpdate &market_update) noexcept -> void {
+            const size_t seq_num = market_update.seq_num_;
+            queued_inc_updates_[seq_num & (queued_inc_updates_.size() - 1)] = market_update;
+            highest_queued_inc_seq_num_ = std::max(highest_queued_inc_seq_num_, seq_num);
+        }
+
+        auto deliver(const Exchange::MEMarketUpdate &market_update) noexcept -> void {
+            *incoming_md_updates_ -> getNextToWriteTo() = market_update;
+            incoming_md_updates_ -> updateWriteIndex();
+        }
+    };
+}
+
+#endif //TRADINGECOSYSTEM_MARKET_DATA_CONSUMER_H
@@ -0,0 +1,146 @@
+/**
+ * Renders log files written by a Logger in LogMode::BINARY back to the text the TEXT mode would have produced.
+ *
+ * usage: log_decoder [-t] <binary log file>...
+ *   -t  prefix every line with the nanosecond timestamp taken when the record was logged.
+ */
+
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include "low-latency-components/log_record.h"
+#include "exchange/order_server/client_request.h"
+#include "exchange/order_server/client_response.h"
+#include "exchange/market_data/market_update.h"
+
+using namespace Common;
+
+namespace
+{
+    /** Every type the exchange logs as a raw struct, looked up by the name recorded in the file. */
+    const LogStructType *KNOWN_STRUCT_TYPES[] = {
+        &LOG_STRUCT_TYPE<Exchange::MEClientRequest>,
+        &LOG_STRUCT_TYPE<Exchange::OMClientRequest>,
+        &LOG_STRUCT_TYPE<Exchange::MEClientResponse>,
+        &LOG_STRUCT_TYPE<Exchange::OMClientResponse>,
+        &LOG_STRUCT_TYPE<Exchange::MEMarketUpdate>,
+        &LOG_STRUCT_TYPE<Exchange::MDPMarketUpdate>,
+    };
+
+    struct StructType
+    {
+        std::string name_;
+        uint32_t size_ = 0;
+        const LogStructType *known_ = nullptr;
+    };
+
+    auto decode(const std::string &file_name, const bool print_time) -> bool
+    {
+        std::ifstream file(file_name, std::ios::binary);
+        if (!file)
+        {
+            std::cerr << "Could not open " << file_name << std::endl;
+            return false;
+        }
+        const std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (data.size() < sizeof(LOG_FILE_MAGIC) || memcmp(data.data(), LOG_FILE_MAGIC, sizeof(LOG_FILE_MAGIC)))
+        {
+            std::cerr << file_name << " is not a binary log file." << std::endl;
+            return false;
+        }
+
+        std::unordered_map<std::string_view, const LogStructType *> known_types;
+        for (const auto type : KNOWN_STRUCT_TYPES)
+            known_types.emplace(type -> name_, type);
+
+        std::vector<std::string> formats;
+        std::vector<StructType> struct_types;
+        std::string line;
+
+        auto struct_size = [&](const uint64_t type_id) { return struct_types.at(type_id).size_; };
+        auto struct_to_string = [&](const uint64_t type_id, const std::byte *object) -> std::string
+        {
+            const auto &type = struct_types.at(type_id);
+            if (type.known_ && type.known_ -> size_ == type.size_)
+                return type.known_ -> to_string_(object);
+            return "<" + type.name_ + ": " + std::to_string(type.size_) + " bytes>";
+        };
+
+        for (size_t offset = sizeof(LOG_FILE_MAGIC); offset + sizeof(LogFileEntryHeader) <= data.size(); )
+        {
+            LogFileEntryHeader entry;
+            memcpy(&entry, data.data() + offset, sizeof(entry));
+            const auto payload = data.data() + offset + sizeof(entry);
+            offset += sizeof(entry) + entry.length_;
+            if (offset > data.size())
+            {
+                std::cerr << file_name << " ends with a truncated entry." << std::endl;
+                return false;
+            }
+
+            switch (entry.type_)
+            {
+            case LogFileEntryType::FORMAT:
+                formats.resize(std::max<size_t>(formats.size(), readLogValue<uint32_t>(reinterpret_cast<const std::byte *>(payload)) + 1));
+                formats[readLogValue<uint32_t>(reinterpret_cast<const std::byte *>(payload))].assign(
+                    payload + sizeof(uint32_t), entry.length_ - sizeof(uint32_t));
+                break;
+
+            case LogFileEntryType::STRUCT_TYPE:
+            {
+                const auto fields = reinterpret_cast<const std::byte *>(payload);
+                const auto type_id = readLogValue<uint32_t>(fields);
+                struct_types.resize(std::max<size_t>(struct_types.size(), type_id + 1));
+                auto &type = struct_types[type_id];
+                type.size_ = readLogValue<uint32_t>(fields + sizeof(uint32_t));
+                type.name_.assign(payload + 2 * sizeof(uint32_t), entry.length_ - 2 * sizeof(uint32_t));
+                const auto known = known_types.find(type.name_);
+                type.known_ = known == known_types.end() ? nullptr : known -> second;
+            } break;
+
+            case LogFileEntryType::RECORD:
+            {
+                LogFileRecord record;
+                memcpy(&record, payload, sizeof(record));
+                line.clear();
+                if (print_time)
+                    line += std::to_string(record.time_) + " ";
+                renderLogRecord(line, formats.at(record.format_id_).c_str(),
+                    reinterpret_cast<const std::byte *>(payload + sizeof(record)), record.num_args_, struct_size, struct_to_string);
+                std::cout << line;
+            } break;
+
+            default:
+                std::cerr << file_name << " has an unknown entry type: " << static_cast<uint32_t>(entry.type_) << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool print_time = false;
+    bool ok = true;
+    int num_files = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::string_view(argv[i]) == "-t")
+        {
+            print_time = true;
+            continue;
+        }
+        ok &= decode(argv[i], print_time);
+        ++num_files;
+    }
+
+    if (!num_files)
+    {
+        std::cerr << "usage: " << argv[0] << " [-t] <binary log file>..." << std::endl;
+        return EXIT_FAILURE;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,97 @@
+/**
+ * Follows the exchange market data streams with a Trading::MarketDataConsumer and prints, once a second, how many
+ * updates were delivered per type, the next expected incremental seq and how many snapshot recoveries happened.
+ * Runs against the exchange over loopback multicast with the defaults.
+ *
+ * usage: market_data_listener [-i iface] [-s snapshot_ip:port] [-n incremental_ip:port] [-c core] [-d seconds] [-u]
+ * -u receives on io_uring instead of recvmmsg().
+ */
+
+#include <array>
+#include <iostream>
+#include "trading/market_data/market_data_consumer.h"
+
+using namespace Common;
+using namespace Exchange;
+
+namespace
+{
+    auto splitEndpoint(const std::string &endpoint, std::string *ip, int *port) -> bool
+    {
+        const auto colon = endpoint.rfind(':');
+        if (colon == std::string::npos)
+            return false;
+        *ip = endpoint.substr(0, colon);
+        *port = std::stoi(endpoint.substr(colon + 1));
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string iface = "lo";
+    std::string snapshot_ip = "233.252.14.1";
+    int snapshot_port = 20000;
+    std::string incremental_ip = "233.252.14.3";
+    int incremental_port = 20001;
+    int core_id = -1;
+    int duration = 0;
+    bool use_io_uring = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg(argv[i]);
+        const auto has_value = i + 1 < argc;
+        if (arg == "-i" && has_value)
+            iface = argv[++i];
+        else if (arg == "-s" && has_value && splitEndpoint(argv[++i], &snapshot_ip, &snapshot_port))
+            continue;
+        else if (arg == "-n" && has_value && splitEndpoint(argv[++i], &incremental_ip, &incremental_port))
+            continue;
+        else if (arg == "-c" && has_value)
+            core_id = std::stoi(argv[++i]);
+        else if (arg == "-d" && has_value)
+            duration = std::stoi(argv[++i]);
+        else if (arg == "-u")
+            use_io_uring = true;
+        else
+        {
+            std::cerr << "usage: " << argv[0]
+                << " [-i iface] [-s snapshot_ip:port] [-n incremental_ip:port] [-c core] [-d seconds] [-u]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+    Trading::MarketDataConsumer consumer(&market_updates, iface, snapshot_ip, snapshot_port,
+        incremental_ip, incremental_port, core_id, use_io_uring);
+    consumer.start();
+
+    std::array<uint64_t, static_cast<size_t>(MEMarketUpdateType::SNAPSHOT_END) + 1> num_updates = {};
+    auto next_report = getCurrentNanos() + NANOS_TO_SECS;
+    const auto end = duration ? getCurrentNanos() + duration * NANOS_TO_SECS : std::numeric_limits<Nanos>::max();
+
+    while (getCurrentNanos() < end)
+    {
+        const auto updates = market_updates.peek();
+        for (const auto &update : updates)
+            ++num_updates[static_cast<size_t>(update.type_)];
+        market_updates.consume(updates.size());
+
+        if (getCurrentNanos() >= next_report)
+        {
+            next_report += NANOS_TO_SECS;
+            std::cout << "next_inc_seq: " << consumer.nextExpectedIncSeqNum()
+                << " recovering: " << consumer.inRecovery()
+                << " recoveries: " << consumer.numRecoveries();
+            for (size_t type = 1; type < num_updates.size(); ++type)
+            {
+                if (num_updates[type])
+                    std::cout << " " << marketUpdateTypeToString(static_cast<MEMarketUpdateType>(type)) << ": " << num_updates[type];
+            }
+            std::cout << std::endl;
+        }
+    }
+    consumer.stop();
+    return EXIT_SUCCESS;
+}